@@ -0,0 +1,310 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+constexpr int CHUNK_SIZE = 32;
+
+// Where chunk contents come from. load() is only ever called from the
+// ChunkedMap I/O thread, so implementations don't need to be thread safe.
+class ChunkSource {
+public:
+	virtual ~ChunkSource() {}
+	virtual olc::vi2d size() const = 0;
+	// Fills CHUNK_SIZE*CHUNK_SIZE cells, row-major. Cells outside the map are padding.
+	virtual bool load(int chunkX, int chunkY, std::vector<int>& cells) = 0;
+};
+
+// Wraps an in-memory grid, handy for small maps and for writing chunk files.
+class MemoryChunkSource : public ChunkSource {
+	std::vector<std::vector<int>> cells;
+	olc::vi2d mapSize;
+public:
+	MemoryChunkSource(const std::vector<std::vector<int>>& cells) : cells(cells), mapSize(cells.empty() ? 0 : (int)cells[0].size(), (int)cells.size()) {}
+
+	olc::vi2d size() const override { return mapSize; }
+
+	bool load(int chunkX, int chunkY, std::vector<int>& out) override {
+		out.assign(CHUNK_SIZE * CHUNK_SIZE, 0);
+		for (int y = 0; y < CHUNK_SIZE; y++) {
+			int my = chunkY * CHUNK_SIZE + y;
+			if (my >= mapSize.y) break;
+			for (int x = 0; x < CHUNK_SIZE; x++) {
+				int mx = chunkX * CHUNK_SIZE + x;
+				if (mx >= mapSize.x) break;
+				out[y * CHUNK_SIZE + x] = cells[my][mx];
+			}
+		}
+		return true;
+	}
+};
+
+// Chunk file layout:
+//   char[4] "RCCH", int32 width, int32 height, int32 chunkSize
+//   then every chunk in row-major chunk order, chunkSize*chunkSize int32 cells each.
+struct ChunkFileHeader {
+	char magic[4];
+	int32_t width;
+	int32_t height;
+	int32_t chunkSize;
+};
+
+class FileChunkSource : public ChunkSource {
+	std::ifstream file;
+	ChunkFileHeader header{};
+	int chunksX = 0;
+public:
+	FileChunkSource(const std::string& path) : file(path, std::ios::binary) {
+		if (file.read((char*)&header, sizeof(header)) && std::equal(header.magic, header.magic + 4, "RCCH") && header.chunkSize == CHUNK_SIZE) {
+			chunksX = (header.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		}
+		else {
+			header.width = header.height = 0;
+		}
+	}
+
+	bool isOpen() const { return header.width > 0; }
+
+	olc::vi2d size() const override { return { header.width, header.height }; }
+
+	bool load(int chunkX, int chunkY, std::vector<int>& out) override {
+		out.resize(CHUNK_SIZE * CHUNK_SIZE);
+		std::streamoff offset = sizeof(header) + std::streamoff(chunkY * chunksX + chunkX) * CHUNK_SIZE * CHUNK_SIZE * sizeof(int32_t);
+		file.clear();
+		file.seekg(offset);
+		static_assert(sizeof(int) == sizeof(int32_t), "chunk cells are stored as int32");
+		return (bool)file.read((char*)out.data(), out.size() * sizeof(int32_t));
+	}
+};
+
+inline bool writeChunkFile(const std::string& path, ChunkSource& source) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	olc::vi2d size = source.size();
+	ChunkFileHeader header = { {'R','C','C','H'}, size.x, size.y, CHUNK_SIZE };
+	file.write((const char*)&header, sizeof(header));
+
+	std::vector<int> cells;
+	for (int cy = 0; cy < (size.y + CHUNK_SIZE - 1) / CHUNK_SIZE; cy++) {
+		for (int cx = 0; cx < (size.x + CHUNK_SIZE - 1) / CHUNK_SIZE; cx++) {
+			if (!source.load(cx, cy, cells)) return false;
+			file.write((const char*)cells.data(), cells.size() * sizeof(int32_t));
+		}
+	}
+	return (bool)file;
+}
+
+// Reads every chunk of a source into one resident grid (benchmarks, small maps).
+inline std::vector<std::vector<int>> readAllCells(ChunkSource& source) {
+	olc::vi2d size = source.size();
+	std::vector<std::vector<int>> rows(size.y, std::vector<int>(size.x));
+	std::vector<int> cells;
+	for (int cy = 0; cy < (size.y + CHUNK_SIZE - 1) / CHUNK_SIZE; cy++) {
+		for (int cx = 0; cx < (size.x + CHUNK_SIZE - 1) / CHUNK_SIZE; cx++) {
+			if (!source.load(cx, cy, cells)) continue;
+			for (int y = 0; y < CHUNK_SIZE && cy * CHUNK_SIZE + y < size.y; y++) {
+				for (int x = 0; x < CHUNK_SIZE && cx * CHUNK_SIZE + x < size.x; x++) {
+					rows[cy * CHUNK_SIZE + y][cx * CHUNK_SIZE + x] = cells[y * CHUNK_SIZE + x];
+				}
+			}
+		}
+	}
+	return rows;
+}
+
+// A map split into CHUNK_SIZE x CHUNK_SIZE chunks that are paged in around a
+// point of interest by a background I/O thread and evicted least-recently-used.
+//
+// Reads (getCell/isSolid/isResident) may come from any number of threads at
+// once, but never while update() or waitIdle() runs: those swap chunks in and
+// out. The I/O thread only ever touches the request and completion queues.
+class ChunkedMap {
+	struct Chunk {
+		std::vector<int> cells;
+		std::list<int>::iterator lruPos;
+	};
+
+	enum class ChunkState : uint8_t { Absent, Pending, Resident };
+
+	std::unique_ptr<ChunkSource> source;
+	olc::vi2d mapSize;
+	olc::vi2d chunkCount;
+	int residentRadius;
+	size_t maxResident;
+	int defaultCell;
+
+	std::vector<std::unique_ptr<Chunk>> chunks;
+	std::vector<ChunkState> states;
+	std::list<int> lru; // front = most recently used
+
+	std::thread ioThread;
+	std::mutex ioMutex;
+	std::condition_variable ioSignal;
+	std::condition_variable ioDrained;
+	std::deque<int> requests;
+	std::vector<std::pair<int, std::unique_ptr<Chunk>>> completed;
+	int inFlight = 0;
+	bool bStop = false;
+	uint32_t generation = 0;
+
+	void ioLoop() {
+		std::unique_lock<std::mutex> lock(ioMutex);
+		while (true) {
+			ioSignal.wait(lock, [&] { return bStop || !requests.empty(); });
+			if (bStop) return;
+
+			int index = requests.front();
+			requests.pop_front();
+			lock.unlock();
+
+			std::unique_ptr<Chunk> chunk(new Chunk());
+			if (!source->load(index % chunkCount.x, index / chunkCount.x, chunk->cells)) {
+				chunk->cells.clear(); // filled with defaultCell once it's back on the map thread
+			}
+
+			lock.lock();
+			completed.emplace_back(index, std::move(chunk));
+			inFlight--;
+			ioDrained.notify_all();
+		}
+	}
+
+	void touch(int index) {
+		Chunk* chunk = chunks[index].get();
+		lru.splice(lru.begin(), lru, chunk->lruPos);
+	}
+
+	void evict() {
+		while (lru.size() > maxResident) {
+			int index = lru.back();
+			lru.pop_back();
+			states[index] = ChunkState::Absent;
+			chunks[index].reset();
+			generation++;
+		}
+	}
+
+	void integrateCompleted() {
+		std::vector<std::pair<int, std::unique_ptr<Chunk>>> done;
+		{
+			std::lock_guard<std::mutex> lock(ioMutex);
+			done.swap(completed);
+		}
+		for (auto& entry : done) {
+			int index = entry.first;
+			if (states[index] != ChunkState::Pending) continue;
+			if (entry.second->cells.empty()) entry.second->cells.assign(CHUNK_SIZE * CHUNK_SIZE, defaultCell);
+			lru.push_front(index);
+			entry.second->lruPos = lru.begin();
+			chunks[index] = std::move(entry.second);
+			states[index] = ChunkState::Resident;
+			generation++;
+		}
+	}
+
+public:
+	// residentRadius is in chunks; maxResident is clamped so the whole resident square always fits.
+	ChunkedMap(std::unique_ptr<ChunkSource> source, int residentRadius = 4, size_t maxResident = 256, int defaultCell = 1)
+		: source(std::move(source)), residentRadius(residentRadius), defaultCell(defaultCell) {
+		mapSize = this->source->size();
+		chunkCount = { (mapSize.x + CHUNK_SIZE - 1) / CHUNK_SIZE, (mapSize.y + CHUNK_SIZE - 1) / CHUNK_SIZE };
+		this->maxResident = std::max(maxResident, size_t((2 * residentRadius + 1) * (2 * residentRadius + 1)));
+		chunks.resize(chunkCount.x * chunkCount.y);
+		states.resize(chunkCount.x * chunkCount.y, ChunkState::Absent);
+		ioThread = std::thread(&ChunkedMap::ioLoop, this);
+	}
+
+	~ChunkedMap() {
+		{
+			std::lock_guard<std::mutex> lock(ioMutex);
+			bStop = true;
+		}
+		ioSignal.notify_all();
+		ioThread.join();
+	}
+
+	olc::vi2d size() const { return mapSize; }
+
+	// Value returned for cells whose chunk isn't resident (yet). Defaults to wall so rays stop at the paging horizon.
+	void setDefaultCell(int cell) { defaultCell = cell; }
+	int getDefaultCell() const { return defaultCell; }
+
+	int getCell(int x, int y) const {
+		const Chunk* chunk = chunks[(y / CHUNK_SIZE) * chunkCount.x + x / CHUNK_SIZE].get();
+		return chunk ? chunk->cells[(y % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE] : defaultCell;
+	}
+
+	bool isSolid(int x, int y) const { return getCell(x, y) > 0; }
+
+	bool isResident(int x, int y) const {
+		return states[(y / CHUNK_SIZE) * chunkCount.x + x / CHUNK_SIZE] == ChunkState::Resident;
+	}
+
+	size_t residentCount() const { return lru.size(); }
+
+	// Bumped whenever a chunk is paged in or out, so caches of map contents know to refresh.
+	uint32_t getGeneration() const { return generation; }
+
+	// Call once per frame: picks up finished loads, requests chunks around center
+	// (nearest first) and evicts whatever fell out of the LRU budget. Requests
+	// from earlier calls that the I/O thread hasn't started on are replaced, so
+	// a fast-moving center never waits behind chunks it already left behind.
+	void update(const olc::vf2d& center) {
+		integrateCompleted();
+		{
+			std::lock_guard<std::mutex> lock(ioMutex);
+			for (int index : requests) states[index] = ChunkState::Absent;
+			inFlight -= (int)requests.size();
+			requests.clear();
+		}
+
+		olc::vi2d centerChunk(int(center.x) / CHUNK_SIZE, int(center.y) / CHUNK_SIZE);
+		std::vector<std::pair<int, int>> wanted; // (distance^2, index)
+		for (int cy = std::max(0, centerChunk.y - residentRadius); cy <= std::min(chunkCount.y - 1, centerChunk.y + residentRadius); cy++) {
+			for (int cx = std::max(0, centerChunk.x - residentRadius); cx <= std::min(chunkCount.x - 1, centerChunk.x + residentRadius); cx++) {
+				int index = cy * chunkCount.x + cx;
+				if (states[index] == ChunkState::Resident) {
+					touch(index);
+				}
+				else if (states[index] == ChunkState::Absent) {
+					int dx = cx - centerChunk.x, dy = cy - centerChunk.y;
+					wanted.push_back({ dx * dx + dy * dy, index });
+				}
+			}
+		}
+
+		if (!wanted.empty()) {
+			std::sort(wanted.begin(), wanted.end());
+			{
+				std::lock_guard<std::mutex> lock(ioMutex);
+				for (auto& w : wanted) {
+					states[w.second] = ChunkState::Pending;
+					requests.push_back(w.second);
+					inFlight++;
+				}
+			}
+			ioSignal.notify_one();
+		}
+
+		evict();
+	}
+
+	// Blocks until every requested chunk has been loaded, then integrates them.
+	void waitIdle() {
+		{
+			std::unique_lock<std::mutex> lock(ioMutex);
+			ioDrained.wait(lock, [&] { return inFlight == 0; });
+		}
+		integrateCompleted();
+		evict();
+	}
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "WorkerPool.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Circles moving through the map: each axis of a movement is applied on its
+// own and stopped by the first solid cell the circle would newly overlap, so
+// what's left of a blocked movement slides along the wall. Cells outside the
+// map count as solid. Map needs size() and isSolid() like cast_ray's.
+//
+// Movements are split into steps of at most MAX_STEP, so the x-then-y path
+// stays close to the straight one however far a circle moves at once.
+class CircleCollision {
+	static constexpr float EPSILON = 1e-4f;  // Kept between a circle and the wall it stopped at
+
+	template <typename Map>
+	static bool blocked(const Map& map, int x, int y) {
+		olc::vi2d size = map.size();
+		return x < 0 || y < 0 || x >= size.x || y >= size.y || map.isSolid(x, y);
+	}
+
+	// New coordinate along the axis (x when bX) after moving by delta
+	template <typename Map>
+	static float slide(const Map& map, const olc::vf2d& pos, float delta, float radius, bool bX) {
+		float along = bX ? pos.x : pos.y, across = bX ? pos.y : pos.x;
+		float target = along + delta;
+		if (delta == 0) return along;
+
+		for (int row = int(std::floor(across - radius)); row <= int(std::floor(across + radius)); row++) {
+			// Half the circle's extent along the axis inside this row
+			float gap = std::max(0.0f, std::max(row - across, across - (row + 1)));
+			if (gap >= radius) continue;
+			float extent = std::sqrt(radius * radius - gap * gap);
+
+			// Starts at the cell the circle already reaches, it may be touching a wall
+			// there from moving along the other axis
+			if (delta > 0) {
+				for (int cell = int(std::floor(along + extent)); cell <= int(std::floor(target + extent)); cell++) {
+					if (bX ? blocked(map, cell, row) : blocked(map, row, cell)) {
+						target = std::max(along, std::min(target, cell - extent - EPSILON));
+						break;
+					}
+				}
+			}
+			else {
+				for (int cell = int(std::floor(along - extent)); cell >= int(std::floor(target - extent)); cell--) {
+					if (bX ? blocked(map, cell, row) : blocked(map, row, cell)) {
+						target = std::min(along, std::max(target, cell + 1 + extent + EPSILON));
+						break;
+					}
+				}
+			}
+		}
+		return target;
+	}
+
+public:
+	static constexpr float MAX_STEP = 0.5f;
+
+	// Where a circle of radius at pos ends up after trying to move by delta
+	template <typename Map>
+	static olc::vf2d move(const Map& map, olc::vf2d pos, const olc::vf2d& delta, float radius) {
+		int steps = std::max(1, int(std::ceil(std::max(std::abs(delta.x), std::abs(delta.y)) / MAX_STEP)));
+		olc::vf2d step = delta / float(steps);
+		for (int i = 0; i < steps; i++) {
+			pos.x = slide(map, pos, step.x, radius, true);
+			pos.y = slide(map, pos, step.y, radius, false);
+		}
+		return pos;
+	}
+
+	// Moves every positions[i] by deltas[i], in place. Circles don't collide with
+	// each other, so they're independent and pool (may be null) can split them up.
+	template <typename Map>
+	static void moveAll(const Map& map, std::vector<olc::vf2d>& positions, const std::vector<olc::vf2d>& deltas, float radius, WorkerPool* pool = nullptr) {
+		auto range = [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				positions[i] = move(map, positions[i], deltas[i], radius);
+			}
+		};
+		if (pool) {
+			pool->parallelFor((int)positions.size(), 1024, range);
+		}
+		else {
+			range(0, (int)positions.size());
+		}
+	}
+};
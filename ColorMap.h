@@ -0,0 +1,59 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Distance shading the way classic raycasters do it: LEVELS precomputed steps
+// from unshaded (0) to all fog (LEVELS - 1). A column picks its level once from
+// its distance, after that shading a texel is only a table lookup: through a
+// shaded copy of its palette, or through a per-channel ramp for true colour.
+class ColorMap {
+public:
+	static constexpr int LEVELS = 32;
+
+private:
+	olc::Pixel fog;
+	float fogStart;
+	float fogEnd;
+	uint8_t ramps[LEVELS][3][256];
+
+public:
+	// Fog starts at fogStart and is complete at fogEnd
+	ColorMap(olc::Pixel fog = olc::BLACK, float fogStart = 2.0f, float fogEnd = 16.0f) : fog(fog), fogStart(fogStart), fogEnd(fogEnd) {
+		const uint8_t fogChannels[3] = { fog.r, fog.g, fog.b };
+		for (int level = 0; level < LEVELS; level++) {
+			float f = level / float(LEVELS - 1);
+			for (int c = 0; c < 3; c++) {
+				for (int v = 0; v < 256; v++) {
+					ramps[level][c][v] = uint8_t(v * (1.0f - f) + fogChannels[c] * f + 0.5f);
+				}
+			}
+		}
+	}
+
+	int levelFor(float distance) const {
+		return levelFor(distance, 1.0f);
+	}
+
+	// For a surface lit with brightness (0 dark to 1 fully lit): darkness fades to
+	// the fog colour as well, which looks right for dark fog
+	int levelFor(float distance, float brightness) const {
+		float fogAmount = std::max(0.0f, std::min(1.0f, (distance - fogStart) / (fogEnd - fogStart)));
+		float f = 1.0f - (1.0f - fogAmount) * brightness;
+		return std::max(0, std::min(LEVELS - 1, int(f * (LEVELS - 1) + 0.5f)));
+	}
+
+	olc::Pixel shade(const olc::Pixel& p, int level) const {
+		return olc::Pixel(ramps[level][0][p.r], ramps[level][1][p.g], ramps[level][2][p.b], p.a);
+	}
+
+	// Appends LEVELS shaded copies of palette[0, size), level by level
+	void shadePalette(const olc::Pixel* palette, int size, std::vector<olc::Pixel>& out) const {
+		for (int level = 0; level < LEVELS; level++) {
+			for (int i = 0; i < size; i++) {
+				out.push_back(shade(palette[i], level));
+			}
+		}
+	}
+};
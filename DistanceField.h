@@ -0,0 +1,181 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "Occupancy.h"
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Per-cell distance (in cells) to the nearest solid cell, capped at `cap`.
+// Walls are 0. Because values are capped, a change to one cell can only affect
+// cells within `cap` of it, which is what keeps update() local.
+class DistanceField {
+public:
+	enum class Metric { Chebyshev, Euclidean };
+
+private:
+	std::vector<uint8_t> values;
+	olc::vi2d fieldSize;
+	Metric metric = Metric::Chebyshev;
+	int cap = 32;
+	float leapTable[256] = {};
+
+	// Scratch buffers reused between updates
+	std::vector<float> scratch;
+	std::vector<float> lineIn, lineOut, envelopeZ;
+	std::vector<int> envelopeV;
+
+	static constexpr int BUILD_BAND = 256;
+
+	// Chessboard distance via the two-pass 3x3 chamfer, exact for unit weights.
+	void chebyshev(std::vector<float>& d, int w, int h) {
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				float v = d[y * w + x];
+				if (x > 0) v = std::min(v, d[y * w + x - 1] + 1);
+				if (y > 0) {
+					v = std::min(v, d[(y - 1) * w + x] + 1);
+					if (x > 0) v = std::min(v, d[(y - 1) * w + x - 1] + 1);
+					if (x < w - 1) v = std::min(v, d[(y - 1) * w + x + 1] + 1);
+				}
+				d[y * w + x] = v;
+			}
+		}
+		for (int y = h - 1; y >= 0; y--) {
+			for (int x = w - 1; x >= 0; x--) {
+				float v = d[y * w + x];
+				if (x < w - 1) v = std::min(v, d[y * w + x + 1] + 1);
+				if (y < h - 1) {
+					v = std::min(v, d[(y + 1) * w + x] + 1);
+					if (x > 0) v = std::min(v, d[(y + 1) * w + x - 1] + 1);
+					if (x < w - 1) v = std::min(v, d[(y + 1) * w + x + 1] + 1);
+				}
+				d[y * w + x] = v;
+			}
+		}
+	}
+
+	// 1D squared distance transform (Felzenszwalb & Huttenlocher), linear in n.
+	void squaredDistance1D(int n) {
+		int k = 0;
+		envelopeV[0] = 0;
+		envelopeZ[0] = -1e20f;
+		envelopeZ[1] = 1e20f;
+		for (int q = 1; q < n; q++) {
+			float s = ((lineIn[q] + q * q) - (lineIn[envelopeV[k]] + envelopeV[k] * envelopeV[k])) / (2.0f * q - 2.0f * envelopeV[k]);
+			while (s <= envelopeZ[k]) {
+				k--;
+				s = ((lineIn[q] + q * q) - (lineIn[envelopeV[k]] + envelopeV[k] * envelopeV[k])) / (2.0f * q - 2.0f * envelopeV[k]);
+			}
+			k++;
+			envelopeV[k] = q;
+			envelopeZ[k] = s;
+			envelopeZ[k + 1] = 1e20f;
+		}
+		k = 0;
+		for (int q = 0; q < n; q++) {
+			while (envelopeZ[k + 1] < q) k++;
+			float dq = float(q - envelopeV[k]);
+			lineOut[q] = dq * dq + lineIn[envelopeV[k]];
+		}
+	}
+
+	// Exact squared Euclidean distance: 1D transform down the columns, then along the rows.
+	void euclidean(std::vector<float>& d, int w, int h) {
+		int n = std::max(w, h);
+		lineIn.resize(n);
+		lineOut.resize(n);
+		envelopeV.resize(n);
+		envelopeZ.resize(n + 1);
+		for (int x = 0; x < w; x++) {
+			for (int y = 0; y < h; y++) lineIn[y] = d[y * w + x];
+			squaredDistance1D(h);
+			for (int y = 0; y < h; y++) d[y * w + x] = lineOut[y];
+		}
+		for (int y = 0; y < h; y++) {
+			std::copy(d.begin() + y * w, d.begin() + (y + 1) * w, lineIn.begin());
+			squaredDistance1D(w);
+			std::copy(lineOut.begin(), lineOut.begin() + w, d.begin() + y * w);
+		}
+		for (float& v : d) v = std::sqrt(v);
+	}
+
+	// Recomputes the cells in [x0, x1) x [y0, y1). Only walls within `cap` can
+	// matter, so the transform runs over the region grown by `cap` on each side.
+	void computeRegion(const OccupancyGrid& occupancy, int x0, int y0, int x1, int y1) {
+		int ex0 = std::max(0, x0 - cap), ey0 = std::max(0, y0 - cap);
+		int ex1 = std::min(fieldSize.x, x1 + cap), ey1 = std::min(fieldSize.y, y1 + cap);
+		int w = ex1 - ex0, h = ey1 - ey0;
+		const float far = metric == Metric::Euclidean ? 1e20f : float(cap);
+
+		scratch.resize(size_t(w) * h);
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				scratch[y * w + x] = occupancy.test(ex0 + x, ey0 + y) ? 0.0f : far;
+			}
+		}
+
+		if (metric == Metric::Chebyshev) chebyshev(scratch, w, h);
+		else euclidean(scratch, w, h);
+
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				values[y * fieldSize.x + x] = (uint8_t)std::min(float(cap), scratch[(y - ey0) * w + (x - ex0)]);
+			}
+		}
+	}
+
+public:
+	DistanceField(Metric metric = Metric::Chebyshev, int cap = 32) { setMetric(metric, cap); }
+
+	void setMetric(Metric metric, int cap) {
+		this->metric = metric;
+		this->cap = std::max(2, std::min(cap, 255));
+		// How far a ray anywhere inside a cell can travel without entering a wall.
+		// The extra quarter cell covers positions that land exactly on a cell edge.
+		float margin = metric == Metric::Chebyshev ? 1.25f : 1.75f;
+		for (int v = 0; v < 256; v++) {
+			leapTable[v] = std::max(0.0f, std::min(v, this->cap) - margin);
+		}
+	}
+
+	Metric getMetric() const { return metric; }
+	int getCap() const { return cap; }
+	olc::vi2d size() const { return fieldSize; }
+
+	// Full rebuild, linear in the number of cells. Done in bands of rows so the
+	// scratch buffer stays small on huge maps.
+	void build(const OccupancyGrid& occupancy) {
+		fieldSize = occupancy.size();
+		values.assign(size_t(fieldSize.x) * fieldSize.y, 0);
+		for (int y = 0; y < fieldSize.y; y += BUILD_BAND) {
+			computeRegion(occupancy, 0, y, fieldSize.x, std::min(fieldSize.y, y + BUILD_BAND));
+		}
+	}
+
+	// Refreshes every cell whose distance may have changed because cells inside
+	// [x0, x1) x [y0, y1) changed.
+	void update(const OccupancyGrid& occupancy, int x0, int y0, int x1, int y1) {
+		computeRegion(occupancy, std::max(0, x0 - cap), std::max(0, y0 - cap), std::min(fieldSize.x, x1 + cap), std::min(fieldSize.y, y1 + cap));
+	}
+
+	// A new wall can only bring distances down, so stamping its neighbourhood is
+	// exact and much cheaper than update(); callers use it for added walls and
+	// defer update() for removed ones (stale values there are merely too small).
+	void addWall(int wx, int wy) {
+		for (int y = std::max(0, wy - cap); y < std::min(fieldSize.y, wy + cap + 1); y++) {
+			for (int x = std::max(0, wx - cap); x < std::min(fieldSize.x, wx + cap + 1); x++) {
+				int dx = std::abs(x - wx), dy = std::abs(y - wy);
+				int d = metric == Metric::Chebyshev ? std::max(dx, dy) : (int)std::sqrt(float(dx * dx + dy * dy));
+				uint8_t& v = values[y * fieldSize.x + x];
+				if (d < v) v = (uint8_t)d;
+			}
+		}
+	}
+
+	uint8_t at(int x, int y) const { return values[y * fieldSize.x + x]; }
+
+	// Distance a ray starting anywhere in cell (x, y) can safely advance.
+	float leap(int x, int y) const { return leapTable[at(x, y)]; }
+
+	size_t memoryBytes() const { return values.size(); }
+};
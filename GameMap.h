@@ -0,0 +1,190 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "Occupancy.h"
+#include "DistanceField.h"
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// Half-open cell rectangle [min, max)
+struct MapRect {
+	olc::vi2d min;
+	olc::vi2d max;
+
+	bool isEmpty() const { return min.x >= max.x || min.y >= max.y; }
+
+	MapRect merged(const MapRect& other) const {
+		return { olc::vi2d(std::min(min.x, other.min.x), std::min(min.y, other.min.y)), olc::vi2d(std::max(max.x, other.max.x), std::max(max.y, other.max.y)) };
+	}
+
+	bool touches(const MapRect& other, int margin) const {
+		return min.x - margin <= other.max.x && other.min.x <= max.x + margin && min.y - margin <= other.max.y && other.min.y <= max.y + margin;
+	}
+};
+
+// Small list of dirty rectangles. Rectangles closer than `margin` are merged so
+// overlapping update windows aren't recomputed twice; past a limit everything
+// collapses into the bounding box.
+class DirtyRegions {
+	std::vector<MapRect> rects;
+	static constexpr size_t MAX_RECTS = 32;
+
+public:
+	void add(MapRect rect, int margin) {
+		for (size_t i = 0; i < rects.size();) {
+			if (rects[i].touches(rect, margin)) {
+				rect = rect.merged(rects[i]);
+				rects[i] = rects.back();
+				rects.pop_back();
+				i = 0;
+			}
+			else {
+				i++;
+			}
+		}
+		rects.push_back(rect);
+		if (rects.size() > MAX_RECTS) {
+			for (size_t i = 1; i < rects.size(); i++) rects[0] = rects[0].merged(rects[i]);
+			rects.resize(1);
+		}
+	}
+
+	bool isEmpty() const { return rects.empty(); }
+	const std::vector<MapRect>& get() const { return rects; }
+	void clear() { rects.clear(); }
+};
+
+// The level grid. Cell types live in a flat array; everything derived from it
+// (occupancy pyramid, distance field, whoever registered a change listener,
+// e.g. the minimap) is kept up to date through the mutation API below.
+//
+// Edits update the occupancy pyramid immediately. Walls that appear are stamped
+// into the distance field immediately too; walls that disappear only leave it
+// conservative, so those regions are recomputed in one go by flushEdits(), which
+// also tells the listeners what changed. Outside a batch every edit flushes.
+class GameMap {
+	std::vector<int> cells;
+	olc::vi2d mapSize;
+	OccupancyPyramid occupancy;
+	DistanceField distanceField;
+
+	DirtyRegions clearedRegions;  // walls removed, distance field needs a recompute here
+	DirtyRegions changedRegions;  // anything changed, reported to listeners
+	std::vector<std::function<void(const MapRect&)>> listeners;
+	int batchDepth = 0;
+
+	void writeCell(int x, int y, int cell) {
+		cells[y * mapSize.x + x] = cell;
+		if (occupancy.test(x, y) != (cell > 0)) {
+			occupancy.set(x, y, cell > 0);
+		}
+	}
+
+	// Applies one edit without flushing; returns true if anything changed.
+	bool editCell(int x, int y, int cell) {
+		if (getCell(x, y) == cell) return false;
+		bool bWasSolid = occupancy.test(x, y);
+		writeCell(x, y, cell);
+		if (!bWasSolid && occupancy.test(x, y)) {
+			distanceField.addWall(x, y);
+		}
+		else if (bWasSolid && !occupancy.test(x, y)) {
+			clearedRegions.add({ olc::vi2d(x, y), olc::vi2d(x + 1, y + 1) }, distanceField.getCap());
+		}
+		return true;
+	}
+
+public:
+	GameMap(const std::vector<std::vector<int>>& rows) {
+		mapSize = { rows.empty() ? 0 : (int)rows[0].size(), (int)rows.size() };
+		cells.resize(size_t(mapSize.x) * mapSize.y);
+		occupancy.resize(mapSize);
+		for (int y = 0; y < mapSize.y; y++) {
+			for (int x = 0; x < mapSize.x; x++) {
+				writeCell(x, y, rows[y][x]);
+			}
+		}
+		distanceField.build(occupancy.level(0));
+	}
+
+	GameMap(const olc::vi2d& size, int fill = 0) : GameMap(std::vector<std::vector<int>>(size.y, std::vector<int>(size.x, fill))) {}
+
+	olc::vi2d size() const { return mapSize; }
+
+	int getCell(int x, int y) const { return cells[y * mapSize.x + x]; }
+
+	bool isSolid(int x, int y) const { return occupancy.test(x, y); }
+
+	void setCell(int x, int y, int cell) {
+		if (editCell(x, y, cell)) {
+			changedRegions.add({ olc::vi2d(x, y), olc::vi2d(x + 1, y + 1) }, 1);
+		}
+		if (batchDepth == 0) flushEdits();
+	}
+
+	// Fills [x, x + w) x [y, y + h), clipped to the map.
+	void fillRect(int x, int y, int w, int h, int cell) {
+		MapRect rect = { olc::vi2d(std::max(0, x), std::max(0, y)), olc::vi2d(std::min(mapSize.x, x + w), std::min(mapSize.y, y + h)) };
+		if (rect.isEmpty()) return;
+		bool bChanged = false;
+		for (int cy = rect.min.y; cy < rect.max.y; cy++) {
+			for (int cx = rect.min.x; cx < rect.max.x; cx++) {
+				bChanged |= editCell(cx, cy, cell);
+			}
+		}
+		if (bChanged) changedRegions.add(rect, 1);
+		if (batchDepth == 0) flushEdits();
+	}
+
+	// Edits between beginBatch() and the matching endBatch() are flushed together.
+	void beginBatch() { batchDepth++; }
+
+	void endBatch() {
+		if (--batchDepth == 0) flushEdits();
+	}
+
+	template <typename Edits>
+	void batch(Edits edits) {
+		beginBatch();
+		edits(*this);
+		endBatch();
+	}
+
+	void flushEdits() {
+		for (const MapRect& rect : clearedRegions.get()) {
+			distanceField.update(occupancy.level(0), rect.min.x, rect.min.y, rect.max.x, rect.max.y);
+		}
+		clearedRegions.clear();
+
+		if (changedRegions.isEmpty()) return;
+		for (const MapRect& rect : changedRegions.get()) {
+			for (auto& listener : listeners) listener(rect);
+		}
+		changedRegions.clear();
+	}
+
+	// Called from flushEdits() with every rectangle of cells that changed.
+	void addChangeListener(std::function<void(const MapRect&)> listener) {
+		listeners.push_back(listener);
+	}
+
+	const OccupancyPyramid& getOccupancy() const { return occupancy; }
+
+	const DistanceField& getDistanceField() const { return distanceField; }
+
+	void setDistanceMetric(DistanceField::Metric metric, int cap = 32) {
+		distanceField.setMetric(metric, cap);
+		distanceField.build(occupancy.level(0));
+		clearedRegions.clear();
+	}
+
+	std::vector<std::vector<int>> rows() const {
+		std::vector<std::vector<int>> result(mapSize.y, std::vector<int>(mapSize.x));
+		for (int y = 0; y < mapSize.y; y++) {
+			for (int x = 0; x < mapSize.x; x++) {
+				result[y][x] = getCell(x, y);
+			}
+		}
+		return result;
+	}
+};
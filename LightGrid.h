@@ -0,0 +1,113 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "GameMap.h"
+#include "ShadowCache.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// A light that may move every frame
+struct PointLight {
+	olc::vf2d pos;
+	float radius;
+	float intensity;
+};
+
+// Moving lights bucketed by the map cells they reach, rebuilt every frame, so a
+// wall column only looks at the lights of the cell it hit instead of all of
+// them. Each cell keeps at most BUDGET lights, the strongest at its centre.
+//
+// Only cells in a window (around the camera, as far as anything is drawn) are
+// bucketed, so the cost follows the lights near the view, not the map size.
+// Lights with a ShadowMap don't reach the points it has in shadow.
+class LightGrid {
+	MapRect window = { { 0, 0 }, { 0, 0 } };
+	int width = 0;
+	std::vector<PointLight> lights;
+	std::vector<std::shared_ptr<const ShadowMap>> shadows;  // Per light, may be null
+	std::vector<uint8_t> counts;     // Per window cell
+	std::vector<uint16_t> slots;     // BUDGET per window cell, indices into lights
+	std::vector<float> weights;      // Strength of each slot's light at the cell centre
+
+	static float falloff(const PointLight& light, float distance) {
+		float f = 1.0f - distance / light.radius;
+		return f > 0 ? f * f : 0.0f;
+	}
+
+	void insert(size_t cell, uint16_t light, float weight) {
+		uint16_t* cellSlots = &slots[cell * BUDGET];
+		float* cellWeights = &weights[cell * BUDGET];
+		if (counts[cell] < BUDGET) {
+			cellSlots[counts[cell]] = light;
+			cellWeights[counts[cell]++] = weight;
+			return;
+		}
+		// Over budget: the weakest light makes room
+		int weakest = int(std::min_element(cellWeights, cellWeights + BUDGET) - cellWeights);
+		if (weight > cellWeights[weakest]) {
+			cellSlots[weakest] = light;
+			cellWeights[weakest] = weight;
+		}
+	}
+
+public:
+	static constexpr int BUDGET = 8;
+	static constexpr size_t MAX_LIGHTS = 65535;
+
+	// Lights past MAX_LIGHTS are dropped. frameShadows is empty or has a (possibly null) map per light.
+	void build(const std::vector<PointLight>& frameLights, const MapRect& window, const std::vector<std::shared_ptr<const ShadowMap>>& frameShadows = {}) {
+		this->window = window;
+		width = std::max(0, window.max.x - window.min.x);
+		size_t cells = window.isEmpty() ? 0 : size_t(width) * (window.max.y - window.min.y);
+		lights.assign(frameLights.begin(), frameLights.begin() + std::min(frameLights.size(), MAX_LIGHTS));
+		shadows.assign(frameShadows.begin(), frameShadows.begin() + std::min(frameShadows.size(), lights.size()));
+		shadows.resize(lights.size());
+		counts.assign(cells, 0);
+		slots.resize(cells * BUDGET);
+		weights.resize(cells * BUDGET);
+
+		for (size_t i = 0; i < lights.size(); i++) {
+			const PointLight& light = lights[i];
+			// Cells with any point closer than radius
+			int x0 = std::max(window.min.x, int(std::floor(light.pos.x - light.radius))), x1 = std::min(window.max.x, int(std::floor(light.pos.x + light.radius)) + 1);
+			int y0 = std::max(window.min.y, int(std::floor(light.pos.y - light.radius))), y1 = std::min(window.max.y, int(std::floor(light.pos.y + light.radius)) + 1);
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					float nx = std::max(float(x), std::min(x + 1.0f, light.pos.x)), ny = std::max(float(y), std::min(y + 1.0f, light.pos.y));
+					if ((olc::vf2d(nx, ny) - light.pos).mag2() >= light.radius * light.radius) continue;
+					float weight = light.intensity * falloff(light, (olc::vf2d(x + 0.5f, y + 0.5f) - light.pos).mag());
+					insert(size_t(y - window.min.y) * width + (x - window.min.x), uint16_t(i), weight);
+				}
+			}
+		}
+	}
+
+	bool isEmpty() const { return lights.empty(); }
+	const std::vector<PointLight>& getLights() const { return lights; }
+
+	// Number of lights reaching cell, their indices into getLights() are in indices[0, count)
+	int lightsAt(const olc::vi2d& cell, const uint16_t*& indices) const {
+		if (cell.x < window.min.x || cell.y < window.min.y || cell.x >= window.max.x || cell.y >= window.max.y) return 0;
+		size_t i = size_t(cell.y - window.min.y) * width + (cell.x - window.min.x);
+		indices = &slots[i * BUDGET];
+		return counts[i];
+	}
+
+	// Light added at point on a wall of cell facing normal (Lambert and quadratic falloff)
+	float brightness(const olc::vi2d& cell, const olc::vf2d& point, const olc::vf2d& normal) const {
+		const uint16_t* indices;
+		int count = lightsAt(cell, indices);
+		float sum = 0.0f;
+		for (int i = 0; i < count; i++) {
+			const PointLight& light = lights[indices[i]];
+			olc::vf2d toLight = light.pos - point;
+			float distance = toLight.mag();
+			if (distance <= 0 || distance >= light.radius) continue;
+			if (shadows[indices[i]] && !shadows[indices[i]]->lit(point)) continue;
+			sum += light.intensity * std::max(0.0f, normal.dot(toLight) / distance) * falloff(light, distance);
+		}
+		return sum;
+	}
+};
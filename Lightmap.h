@@ -0,0 +1,309 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "GameMap.h"
+#include "Raycast.h"
+#include "WorkerPool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// A light that never moves, reaching radius cells
+struct StaticLight {
+	olc::vf2d pos;
+	float radius;
+	float intensity;
+};
+
+// Lightmap file layout:
+//   LightmapFileHeader: char[4] "RCLM", uint32 version, int32 map width, int32 map height,
+//                       int32 luxels per face, uint32 face count, uint64 light hash, uint64 cell hash
+//   then face count uint64 face keys, then face count * luxels per face bytes of brightness.
+struct LightmapFileHeader {
+	char magic[4];
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t luxelsPerFace;
+	uint32_t faceCount;
+	uint64_t lightHash;
+	uint64_t cellHash;
+};
+
+// Light from static lights on every wall face they reach, baked ahead of time.
+// Walls span the whole screen height and the lights are at eye level, so a
+// face's light only varies along it: each face keeps LUXELS brightness samples
+// across its width, and drawing a column costs one lookup and a lerp.
+//
+// Faces are numbered like WallSegment's (0/1 = low/high x, 2/3 = low/high y).
+// Each luxel adds up the lights that reach it unoccluded (a cast_ray from the
+// light), with Lambert and a quadratic falloff, on top of the ambient light.
+// Faces no light reaches are only stored implicitly, at ambient.
+class Lightmap {
+	olc::vi2d mapSize;
+	std::vector<StaticLight> lights;
+	float ambient = 1.0f;
+	uint64_t cellHash = 0;
+	bool bValid = false;
+	std::unordered_map<uint64_t, uint32_t> faces;  // Face key -> index of its first luxel / LUXELS
+	std::vector<uint8_t> luxels;
+
+	uint64_t key(int x, int y, int face) const { return (uint64_t(y) * mapSize.x + x) * 4 + face; }
+
+	static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull; // FNV-1a
+		}
+		return hash;
+	}
+
+	uint64_t lightHash() const {
+		uint64_t hash = hashBytes(14695981039346656037ull, &ambient, sizeof(ambient));
+		for (const StaticLight& light : lights) {
+			hash = hashBytes(hash, &light, sizeof(light));
+		}
+		return hash;
+	}
+
+	// Cells that can affect a light: within its radius, plus the neighbours that decide which faces are exposed
+	static MapRect reach(const StaticLight& light, const olc::vi2d& size) {
+		return { olc::vi2d(std::max(0, int(std::floor(light.pos.x - light.radius)) - 1), std::max(0, int(std::floor(light.pos.y - light.radius)) - 1)),
+			olc::vi2d(std::min(size.x, int(std::ceil(light.pos.x + light.radius)) + 2), std::min(size.y, int(std::ceil(light.pos.y + light.radius)) + 2)) };
+	}
+
+	template <typename Map>
+	static bool exposed(const Map& map, int x, int y, int face) {
+		static constexpr int dx[4] = { -1, 1, 0, 0 };
+		static constexpr int dy[4] = { 0, 0, -1, 1 };
+		int nx = x + dx[face], ny = y + dy[face];
+		if (nx < 0 || ny < 0 || nx >= map.size().x || ny >= map.size().y) return false;
+		return map.isSolid(x, y) && !map.isSolid(nx, ny);
+	}
+
+	// A face and one of the lights that reach it
+	typedef std::pair<uint64_t, uint32_t> FaceLight;
+
+	// Exposed faces in rect that have lights[light] on their outer side
+	template <typename Map>
+	void collectFaces(const Map& map, uint32_t light, const MapRect& rect, std::vector<FaceLight>& out) const {
+		const olc::vf2d& pos = lights[light].pos;
+		for (int y = rect.min.y; y < rect.max.y; y++) {
+			for (int x = rect.min.x; x < rect.max.x; x++) {
+				if (!map.isSolid(x, y)) continue;
+				const bool bFacing[4] = { pos.x < x, pos.x > x + 1, pos.y < y, pos.y > y + 1 };
+				for (int face = 0; face < 4; face++) {
+					if (bFacing[face] && exposed(map, x, y, face)) out.push_back({ key(x, y, face), light });
+				}
+			}
+		}
+	}
+
+	// Lights [begin, end) all belong to the same face
+	template <typename Map>
+	void bakeFace(const Map& map, const FaceLight* begin, const FaceLight* end, uint8_t* out) const {
+		static const olc::vf2d normals[4] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+		int face = int(begin->first % 4);
+		olc::vi2d cell(int(begin->first / 4 % mapSize.x), int(begin->first / 4 / mapSize.x));
+		const olc::vf2d& normal = normals[face];
+
+		for (int i = 0; i < LUXELS; i++) {
+			// Just outside the face, so the ray towards it ends in the empty cell in front
+			float along = (i + 0.5f) / LUXELS;
+			olc::vf2d point = face < 2 ? olc::vf2d(float(cell.x + face), cell.y + along) : olc::vf2d(cell.x + along, float(cell.y + face - 2));
+			point += normal * 1e-3f;
+
+			float light = ambient;
+			for (const FaceLight* it = begin; it != end; ++it) {
+				const StaticLight& source = lights[it->second];
+				olc::vf2d toLight = source.pos - point;
+				float distance = toLight.mag();
+				float facing = distance > 0 ? normal.dot(toLight) / distance : 0.0f;
+				if (distance >= source.radius || facing <= 0) continue;
+				RaycastResult hit = cast_ray(source.pos, -toLight / distance, map, distance);
+				if (hit.bHit && hit.cell != cell && hit.distance < distance) continue;
+				float falloff = 1.0f - distance / source.radius;
+				light += source.intensity * facing * falloff * falloff;
+			}
+			out[i] = uint8_t(std::min(1.0f, light) * 255.0f + 0.5f);
+		}
+	}
+
+	// Bakes the faces in faceLights into new luxels appended after the existing ones
+	template <typename Map>
+	void bakeFaces(const Map& map, std::vector<FaceLight> faceLights, WorkerPool* pool) {
+		std::sort(faceLights.begin(), faceLights.end());
+		faceLights.erase(std::unique(faceLights.begin(), faceLights.end()), faceLights.end());
+		std::vector<size_t> starts;  // Of each face's lights
+		for (size_t i = 0; i < faceLights.size(); i++) {
+			if (i == 0 || faceLights[i].first != faceLights[i - 1].first) starts.push_back(i);
+		}
+		starts.push_back(faceLights.size());
+
+		uint32_t first = uint32_t(luxels.size() / LUXELS);
+		int count = (int)starts.size() - 1;
+		luxels.resize(luxels.size() + size_t(count) * LUXELS);
+		for (int i = 0; i < count; i++) {
+			faces[faceLights[starts[i]].first] = first + uint32_t(i);
+		}
+
+		// Every face writes its own luxels
+		auto bake = [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				bakeFace(map, &faceLights[starts[i]], faceLights.data() + starts[i + 1], &luxels[(size_t(first) + i) * LUXELS]);
+			}
+		};
+		if (pool) {
+			pool->parallelFor(count, 64, bake);
+		}
+		else {
+			bake(0, count);
+		}
+	}
+
+public:
+	static constexpr int LUXELS = 8;
+	static constexpr uint32_t VERSION = 1;
+
+	bool isValid() const { return bValid; }
+	size_t faceCount() const { return faces.size(); }
+	uint64_t getCellHash() const { return cellHash; }
+
+	// Drops the baked light; takes effect on the next bake() or load()
+	void setLights(const std::vector<StaticLight>& lights, float ambient) {
+		this->lights = lights;
+		this->ambient = ambient;
+		clear();
+	}
+
+	void clear() {
+		faces.clear();
+		luxels.clear();
+		bValid = false;
+	}
+
+	// Hash of every cell the lights can reach, a bake is only valid for cells with the same hash
+	template <typename Map>
+	uint64_t hashCells(const Map& map) const {
+		olc::vi2d size = map.size();
+		uint64_t hash = hashBytes(14695981039346656037ull, &size, sizeof(size));
+		for (const StaticLight& light : lights) {
+			MapRect rect = reach(light, size);
+			for (int y = rect.min.y; y < rect.max.y; y++) {
+				for (int x = rect.min.x; x < rect.max.x; x++) {
+					int cell = map.getCell(x, y);
+					hash = hashBytes(hash, &cell, sizeof(cell));
+				}
+			}
+		}
+		return hash;
+	}
+
+	// Map needs size(), isSolid() and getCell() like cast_ray's. pool may be null.
+	template <typename Map>
+	void bake(const Map& map, WorkerPool* pool = nullptr) {
+		clear();
+		mapSize = map.size();
+		cellHash = hashCells(map);
+		std::vector<FaceLight> faceLights;
+		for (uint32_t i = 0; i < lights.size(); i++) {
+			collectFaces(map, i, reach(lights[i], mapSize), faceLights);
+		}
+		bakeFaces(map, std::move(faceLights), pool);
+		bValid = true;
+	}
+
+	// Cells in rect changed: rebakes every face of the lights that can reach them
+	template <typename Map>
+	void update(const Map& map, const MapRect& rect) {
+		if (!bValid) return;
+		std::vector<MapRect> stale;
+		for (const StaticLight& light : lights) {
+			MapRect r = reach(light, mapSize);
+			if (r.touches(rect, 0)) stale.push_back(r);
+		}
+		if (stale.empty()) return;
+
+		// Keeps the faces outside every stale rectangle, compacted
+		std::unordered_map<uint64_t, uint32_t> kept;
+		std::vector<uint8_t> keptLuxels;
+		for (const auto& entry : faces) {
+			int x = int(entry.first / 4 % mapSize.x), y = int(entry.first / 4 / mapSize.x);
+			if (std::any_of(stale.begin(), stale.end(), [&](const MapRect& r) { return x >= r.min.x && y >= r.min.y && x < r.max.x && y < r.max.y; })) continue;
+			kept[entry.first] = uint32_t(keptLuxels.size() / LUXELS);
+			keptLuxels.insert(keptLuxels.end(), luxels.begin() + size_t(entry.second) * LUXELS, luxels.begin() + size_t(entry.second + 1) * LUXELS);
+		}
+		faces.swap(kept);
+		luxels.swap(keptLuxels);
+
+		// Faces of other lights in the stale rectangles were dropped too and come back here
+		std::vector<FaceLight> faceLights;
+		for (uint32_t i = 0; i < lights.size(); i++) {
+			MapRect r = reach(lights[i], mapSize);
+			for (const MapRect& s : stale) {
+				MapRect overlap = { olc::vi2d(std::max(r.min.x, s.min.x), std::max(r.min.y, s.min.y)), olc::vi2d(std::min(r.max.x, s.max.x), std::min(r.max.y, s.max.y)) };
+				if (!overlap.isEmpty()) collectFaces(map, i, overlap, faceLights);
+			}
+		}
+		bakeFaces(map, std::move(faceLights), nullptr);
+		cellHash = hashCells(map);
+	}
+
+	// Light on a face, from 0 (dark) to 1, at `along` (0 to 1) across it; 1 when nothing is baked
+	float brightness(const olc::vi2d& cell, int face, float along) const {
+		if (!bValid) return 1.0f;
+		auto it = faces.find(key(cell.x, cell.y, face));
+		if (it == faces.end()) return ambient;
+		const uint8_t* samples = &luxels[size_t(it->second) * LUXELS];
+		float t = std::max(0.0f, std::min(float(LUXELS - 1), along * LUXELS - 0.5f));
+		int i = std::min(int(t), LUXELS - 2);
+		return (samples[i] + (samples[i + 1] - samples[i]) * (t - i)) / 255.0f;
+	}
+
+	bool save(const std::string& path) const {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) return false;
+		std::vector<uint64_t> keys(faces.size());
+		std::vector<uint8_t> samples(faces.size() * LUXELS);
+		size_t i = 0;
+		for (const auto& entry : faces) {
+			keys[i] = entry.first;
+			std::memcpy(&samples[i * LUXELS], &luxels[size_t(entry.second) * LUXELS], LUXELS);
+			i++;
+		}
+		LightmapFileHeader header = { {'R','C','L','M'}, VERSION, mapSize.x, mapSize.y, LUXELS, (uint32_t)keys.size(), lightHash(), cellHash };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)keys.data(), keys.size() * sizeof(uint64_t));
+		file.write((const char*)samples.data(), samples.size());
+		return (bool)file;
+	}
+
+	// Fails (and leaves the lightmap empty) unless the file was baked for a map of
+	// mapSize with the current lights. Whether the cells still match is up to the
+	// caller, through getCellHash().
+	bool load(const std::string& path, const olc::vi2d& mapSize) {
+		clear();
+		std::ifstream file(path, std::ios::binary);
+		LightmapFileHeader header{};
+		if (!file.read((char*)&header, sizeof(header)) || !std::equal(header.magic, header.magic + 4, "RCLM") || header.version != VERSION
+			|| header.luxelsPerFace != LUXELS || olc::vi2d(header.width, header.height) != mapSize || header.lightHash != lightHash()) {
+			return false;
+		}
+		std::vector<uint64_t> keys(header.faceCount);
+		luxels.resize(size_t(header.faceCount) * LUXELS);
+		if (!file.read((char*)keys.data(), keys.size() * sizeof(uint64_t)) || !file.read((char*)luxels.data(), luxels.size())) {
+			clear();
+			return false;
+		}
+		this->mapSize = mapSize;
+		for (uint32_t i = 0; i < header.faceCount; i++) {
+			faces[keys[i]] = i;
+		}
+		cellHash = header.cellHash;
+		bValid = true;
+		return true;
+	}
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "GameMap.h"
+#include <functional>
+
+// Fixed-size minimap centred on a point, with zoom levels. The static part
+// (walls) is rendered per minimap pixel into a sprite, so its cost depends on
+// the minimap size only, never on the map size. When zoomed out past one cell
+// per pixel it reads the aggregated occupancy pyramid levels instead of cells.
+// The sprite is only re-rendered when the view moves by a pixel, the zoom
+// changes or map cells inside the view change.
+class Minimap {
+public:
+	// Pixels per cell for each zoom level, most detailed first
+	static constexpr float ZOOM_LEVELS[] = { 10.0f, 4.0f, 1.0f, 1.0f / 8.0f, 1.0f / 64.0f };
+	static constexpr int ZOOM_LEVEL_COUNT = 5;
+
+private:
+	olc::Sprite* sprite;
+	int zoom = 0;
+	olc::vi2d origin;       // Top-left of the view, in zoomed pixels
+	olc::vi2d mapSize;
+	bool bStale = true;
+
+	MapRect viewCells() const {
+		float ppc = pixelsPerCell();
+		olc::vi2d min(int(std::floor(origin.x / ppc)), int(std::floor(origin.y / ppc)));
+		olc::vi2d max(int(std::ceil((origin.x + sprite->width) / ppc)) + 1, int(std::ceil((origin.y + sprite->height) / ppc)) + 1);
+		return { min, max };
+	}
+
+	static int floorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+	void render(const std::function<bool(int, int)>& isWall, const OccupancyPyramid* pyramid) {
+		float ppc = pixelsPerCell();
+		olc::Pixel* pixels = sprite->GetData();
+
+		for (int py = 0; py < sprite->height; py++) {
+			int gy = origin.y + py;
+			for (int px = 0; px < sprite->width; px++) {
+				int gx = origin.x + px;
+				olc::Pixel color = olc::BLANK;
+
+				if (ppc >= 1.0f) {
+					int cellPixels = int(ppc);
+					int cx = floorDiv(gx, cellPixels), cy = floorDiv(gy, cellPixels);
+					if (cx >= 0 && cx < mapSize.x && cy >= 0 && cy < mapSize.y && isWall(cx, cy)) {
+						int ix = gx - cx * cellPixels, iy = gy - cy * cellPixels;
+						// Outlined cells when there's room for it, solid pixels otherwise
+						if (cellPixels < 4 || ix == 0 || iy == 0 || ix == cellPixels - 1 || iy == cellPixels - 1) {
+							color = olc::WHITE;
+						}
+					}
+				}
+				else {
+					int cellsPerPixel = int(1.0f / ppc);
+					int cx = gx * cellsPerPixel, cy = gy * cellsPerPixel;
+					if (gx >= 0 && cx < mapSize.x && gy >= 0 && cy < mapSize.y) {
+						bool bAnySolid;
+						if (pyramid) {
+							int log2Size = 0;
+							while ((1 << log2Size) < cellsPerPixel) log2Size++;
+							bAnySolid = !pyramid->blockEmpty(log2Size, cx, cy);
+						}
+						else {
+							bAnySolid = isWall(cx, cy);
+						}
+						if (bAnySolid) color = olc::GREY;
+					}
+				}
+
+				pixels[py * sprite->width + px] = color;
+			}
+		}
+	}
+
+public:
+	Minimap(const olc::vi2d& size) {
+		sprite = new olc::Sprite(size.x, size.y);
+	}
+
+	~Minimap() {
+		delete sprite;
+	}
+
+	olc::Sprite* getSprite() const { return sprite; }
+	olc::vi2d size() const { return { sprite->width, sprite->height }; }
+	float pixelsPerCell() const { return ZOOM_LEVELS[zoom]; }
+
+	void zoomIn() {
+		if (zoom > 0) { zoom--; bStale = true; }
+	}
+
+	void zoomOut() {
+		if (zoom < ZOOM_LEVEL_COUNT - 1) { zoom++; bStale = true; }
+	}
+
+	void invalidateAll() { bStale = true; }
+
+	void invalidate(const MapRect& rect) {
+		MapRect view = viewCells();
+		if (rect.min.x < view.max.x && view.min.x < rect.max.x && rect.min.y < view.max.y && view.min.y < rect.max.y) {
+			bStale = true;
+		}
+	}
+
+	// Re-centres the view on `center` (in cells) and re-renders if anything visible changed,
+	// returns true if it did. pyramid may be null (e.g. streamed worlds), then zoomed-out
+	// pixels point-sample cells.
+	bool update(const olc::vf2d& center, const olc::vi2d& mapSize, const std::function<bool(int, int)>& isWall, const OccupancyPyramid* pyramid) {
+		float ppc = pixelsPerCell();
+		olc::vi2d newOrigin(int(std::floor(center.x * ppc)) - sprite->width / 2, int(std::floor(center.y * ppc)) - sprite->height / 2);
+		if (newOrigin != origin || mapSize != this->mapSize) {
+			origin = newOrigin;
+			this->mapSize = mapSize;
+			bStale = true;
+		}
+		if (!bStale) {
+			return false;
+		}
+		render(isWall, pyramid);
+		bStale = false;
+		return true;
+	}
+
+	// Map position (in cells) to a position relative to the minimap's top-left corner
+	olc::vf2d toMinimap(const olc::vf2d& pos) const {
+		return pos * pixelsPerCell() - olc::vf2d(origin);
+	}
+
+	// Clips the segment to the minimap rectangle (Liang-Barsky). Returns false if nothing is left.
+	bool clip(olc::vf2d& a, olc::vf2d& b) const {
+		float t0 = 0.0f, t1 = 1.0f;
+		olc::vf2d d = b - a;
+		float p[4] = { -d.x, d.x, -d.y, d.y };
+		float q[4] = { a.x, sprite->width - 1 - a.x, a.y, sprite->height - 1 - a.y };
+		for (int i = 0; i < 4; i++) {
+			if (p[i] == 0) {
+				if (q[i] < 0) return false;
+			}
+			else {
+				float t = q[i] / p[i];
+				if (p[i] < 0) t0 = std::max(t0, t);
+				else t1 = std::min(t1, t);
+			}
+		}
+		if (t0 > t1) return false;
+		b = a + d * t1;
+		a = a + d * t0;
+		return true;
+	}
+
+	bool contains(const olc::vf2d& p) const {
+		return p.x >= 0 && p.y >= 0 && p.x < sprite->width && p.y < sprite->height;
+	}
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <vector>
+#include <cstdint>
+
+// 1 bit per cell "is this a wall" bitmap. Bits are stored in 8x8 tiles, one
+// uint64_t per tile, so a ray walking in any direction stays inside the same
+// word for several steps instead of striding across rows.
+class OccupancyGrid {
+	std::vector<uint64_t> tiles;
+	olc::vi2d gridSize;
+	int tilesX = 0;
+
+	static uint64_t bit(int x, int y) { return uint64_t(1) << (((y & 7) << 3) | (x & 7)); }
+
+public:
+	OccupancyGrid() = default;
+	OccupancyGrid(const olc::vi2d& size) { resize(size); }
+
+	void resize(const olc::vi2d& size) {
+		gridSize = size;
+		tilesX = (size.x + 7) >> 3;
+		tiles.assign(size_t(tilesX) * ((size.y + 7) >> 3), 0);
+	}
+
+	olc::vi2d size() const { return gridSize; }
+
+	bool test(int x, int y) const {
+		return (tiles[(y >> 3) * tilesX + (x >> 3)] & bit(x, y)) != 0;
+	}
+
+	// The whole 8x8 tile containing (x, y)
+	uint64_t tileAt(int x, int y) const { return tiles[(y >> 3) * tilesX + (x >> 3)]; }
+
+	// True if the 4x4 quarter of the tile containing (x, y) has no solid cells
+	bool quadEmpty(int x, int y) const {
+		return (tileAt(x, y) & (uint64_t(0x0F0F0F0F) << (((y & 4) << 3) | (x & 4)))) == 0;
+	}
+
+	void set(int x, int y, bool bSolid) {
+		uint64_t& tile = tiles[(y >> 3) * tilesX + (x >> 3)];
+		if (bSolid) tile |= bit(x, y);
+		else tile &= ~bit(x, y);
+	}
+
+	size_t memoryBytes() const { return tiles.size() * sizeof(uint64_t); }
+};
+
+// Occupancy at several resolutions. Level 0 is the per-cell bitmap; every
+// coarser level has one bit per 8x8 tile of the level below it ("is anything in
+// there solid"), so a level-k bit covers 8^k x 8^k cells. Changing a cell only
+// touches one word per level.
+class OccupancyPyramid {
+	std::vector<OccupancyGrid> levels;
+
+public:
+	static constexpr int MAX_COARSE_LEVELS = 3;
+
+	void resize(const olc::vi2d& size) {
+		levels.clear();
+		levels.emplace_back(size);
+		olc::vi2d levelSize = size;
+		while ((int)levels.size() <= MAX_COARSE_LEVELS && (levelSize.x > 8 || levelSize.y > 8)) {
+			levelSize = { (levelSize.x + 7) >> 3, (levelSize.y + 7) >> 3 };
+			levels.emplace_back(levelSize);
+		}
+	}
+
+	olc::vi2d size() const { return levels[0].size(); }
+
+	bool test(int x, int y) const { return levels[0].test(x, y); }
+
+	void set(int x, int y, bool bSolid) {
+		for (OccupancyGrid& level : levels) {
+			bool bWasEmpty = level.tileAt(x, y) == 0;
+			level.set(x, y, bSolid);
+			if (bWasEmpty == (level.tileAt(x, y) == 0)) break;
+			bSolid = bWasEmpty; // the tile flipped, so its bit one level up flips the same way
+			x >>= 3;
+			y >>= 3;
+		}
+	}
+
+	// True if the aligned (1 << log2Size)^2 block containing cell (x, y) has no
+	// solid cells. Supported sizes: 4, and 8^k for k up to the number of levels.
+	bool blockEmpty(int log2Size, int x, int y) const {
+		if (log2Size == 2) return levels[0].quadEmpty(x, y);
+		int level = log2Size / 3 - 1;
+		if (level >= (int)levels.size()) return false;
+		return levels[level].tileAt(x >> (3 * level), y >> (3 * level)) == 0;
+	}
+
+	int levelCount() const { return (int)levels.size(); }
+
+	const OccupancyGrid& level(int i) const { return levels[i]; }
+
+	size_t memoryBytes() const {
+		size_t bytes = 0;
+		for (const OccupancyGrid& level : levels) bytes += level.memoryBytes();
+		return bytes;
+	}
+};
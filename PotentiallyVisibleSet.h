@@ -0,0 +1,199 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "WorkerPool.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// PVS file layout:
+//   char[4] "RCPV", int32 width, int32 height, int32 blockSize, int32 radius, float maxDistance
+//   then per block, in row-major block order, ceil((2*radius+1)^2 / 8) bytes of visibility bits.
+struct PvsFileHeader {
+	char magic[4];
+	int32_t width;
+	int32_t height;
+	int32_t blockSize;
+	int32_t radius;
+	float maxDistance;
+};
+
+// Visibility of a static map, stored per 4x4 block (BLOCK_SIZE) rather than per
+// cell: for every block, which blocks around it (at most radius blocks away in x
+// and y) can be seen from its empty cells, within maxDistance. Wall faces belong
+// to their solid cells, so a block that isn't visible has no visible faces either.
+//
+// Visibility is sampled: rays are cast in all directions from the centre and
+// the corners of every empty cell, and every cell they pass or hit, plus its
+// neighbours (sprites are drawn up to half a cell around their position), is
+// marked. One bit per pair of blocks, so a 4096x4096 map with a 16 cell view
+// distance takes about 16 MB.
+class PotentiallyVisibleSet {
+	olc::vi2d mapSize;
+	olc::vi2d blockCount;
+	int radius = 0;
+	float maxDistance = 0.0f;
+	int bytesPerBlock = 0;
+	std::vector<uint8_t> bits;
+
+	int span() const { return 2 * radius + 1; }
+
+	// Rays end in the first cell past maxDistance, which is at most this many cells from the block
+	static int margin(float maxDistance) { return int(std::ceil(maxDistance)) + 3; }
+
+	void setLayout(const olc::vi2d& size, int radius, float maxDistance) {
+		mapSize = size;
+		blockCount = { (size.x + BLOCK_SIZE - 1) / BLOCK_SIZE, (size.y + BLOCK_SIZE - 1) / BLOCK_SIZE };
+		this->radius = radius;
+		this->maxDistance = maxDistance;
+		bytesPerBlock = (span() * span() + 7) / 8;
+	}
+
+	// Calls visit(x, y) for the cells a ray passes through until it hits a solid cell
+	// (included) or travels maxDistance
+	template <typename Map, typename Visit>
+	static void traceRay(const Map& map, const olc::vf2d& start, const olc::vf2d& dir, float maxDistance, Visit visit) {
+		olc::vi2d size = map.size();
+		olc::vi2d cell = start;
+		olc::vi2d step(dir.x > 0 ? 1 : -1, dir.y > 0 ? 1 : -1);
+		olc::vf2d delta(dir.x == 0 ? INFINITY : std::abs(1.0f / dir.x), dir.y == 0 ? INFINITY : std::abs(1.0f / dir.y));
+		olc::vf2d next((dir.x > 0 ? cell.x + 1 - start.x : start.x - cell.x) * delta.x, (dir.y > 0 ? cell.y + 1 - start.y : start.y - cell.y) * delta.y);
+
+		visit(cell.x, cell.y);
+		float distance = 0.0f;
+		while (distance < maxDistance) {
+			if (next.x < next.y) {
+				cell.x += step.x;
+				distance = next.x;
+				next.x += delta.x;
+			}
+			else {
+				cell.y += step.y;
+				distance = next.y;
+				next.y += delta.y;
+			}
+			if (cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y) return;
+			visit(cell.x, cell.y);
+			if (map.isSolid(cell.x, cell.y)) return;
+		}
+	}
+
+	template <typename Map>
+	void buildBlock(const Map& map, int bx, int by, std::vector<uint8_t>& seen) {
+		int margin = PotentiallyVisibleSet::margin(maxDistance);
+		olc::vi2d origin(bx * BLOCK_SIZE - margin, by * BLOCK_SIZE - margin);
+		int window = BLOCK_SIZE + 2 * margin;
+		seen.assign(size_t(window) * window, 0);
+
+		int rays = std::max(8, int(std::ceil(2.0f * 3.14159265f * maxDistance / RAY_SPACING)));
+		auto mark = [&](int x, int y) {
+			x -= origin.x;
+			y -= origin.y;
+			if (x >= 0 && y >= 0 && x < window && y < window) seen[y * window + x] = 1;
+		};
+		for (int cy = by * BLOCK_SIZE; cy < std::min(mapSize.y, (by + 1) * BLOCK_SIZE); cy++) {
+			for (int cx = bx * BLOCK_SIZE; cx < std::min(mapSize.x, (bx + 1) * BLOCK_SIZE); cx++) {
+				if (map.isSolid(cx, cy)) continue;
+				const olc::vf2d points[] = { { 0.5f, 0.5f }, { 0.05f, 0.05f }, { 0.95f, 0.05f }, { 0.05f, 0.95f }, { 0.95f, 0.95f } };
+				for (const olc::vf2d& point : points) {
+					for (int i = 0; i < rays; i++) {
+						float angle = i * 2.0f * 3.14159265f / rays;
+						traceRay(map, olc::vf2d(float(cx), float(cy)) + point, { cosf(angle), sinf(angle) }, maxDistance, mark);
+					}
+				}
+			}
+		}
+
+		uint8_t* out = &bits[(size_t(by) * blockCount.x + bx) * bytesPerBlock];
+		for (int y = 0; y < window; y++) {
+			for (int x = 0; x < window; x++) {
+				if (!seen[y * window + x]) continue;
+				for (int ny = y - 1; ny <= y + 1; ny++) {
+					for (int nx = x - 1; nx <= x + 1; nx++) {
+						int tx = (origin.x + nx) / BLOCK_SIZE - bx + radius, ty = (origin.y + ny) / BLOCK_SIZE - by + radius;
+						if (origin.x + nx < 0 || origin.y + ny < 0 || tx < 0 || ty < 0 || tx >= span() || ty >= span()) continue;
+						int bit = ty * span() + tx;
+						out[bit >> 3] |= uint8_t(1 << (bit & 7));
+					}
+				}
+			}
+		}
+	}
+
+public:
+	static constexpr int BLOCK_SIZE = 4;
+	static constexpr float RAY_SPACING = 0.5f;  // Cells between neighbouring sample rays at maxDistance
+
+	bool isValid() const { return !bits.empty(); }
+	olc::vi2d size() const { return mapSize; }
+	float getMaxDistance() const { return maxDistance; }
+
+	void clear() {
+		bits.clear();
+		mapSize = { 0, 0 };
+	}
+
+	// Offline step; Map needs size() and isSolid() like cast_ray's. pool may be null.
+	template <typename Map>
+	void build(const Map& map, float maxDistance, WorkerPool* pool = nullptr) {
+		setLayout(map.size(), (margin(maxDistance) + BLOCK_SIZE) / BLOCK_SIZE, maxDistance); // margin plus the dilation
+		bits.assign(size_t(blockCount.x) * blockCount.y * bytesPerBlock, 0);
+
+		// Rows of blocks write disjoint ranges of bits
+		auto rows = [&](int begin, int end) {
+			std::vector<uint8_t> seen;
+			for (int by = begin; by < end; by++) {
+				for (int bx = 0; bx < blockCount.x; bx++) {
+					buildBlock(map, bx, by, seen);
+				}
+			}
+		};
+		if (pool) {
+			pool->parallelFor(blockCount.y, 1, rows);
+		}
+		else {
+			rows(0, blockCount.y);
+		}
+	}
+
+	// Can anything in the block holding cell `to` be seen from the block holding cell
+	// `from`? Unknown cells count as visible.
+	bool visible(const olc::vi2d& from, const olc::vi2d& to) const {
+		if (bits.empty() || from.x < 0 || from.y < 0 || from.x >= mapSize.x || from.y >= mapSize.y) return true;
+		olc::vi2d fromBlock = from / BLOCK_SIZE;
+		int tx = (to.x < 0 ? -1 : to.x / BLOCK_SIZE) - fromBlock.x + radius, ty = (to.y < 0 ? -1 : to.y / BLOCK_SIZE) - fromBlock.y + radius;
+		if (tx < 0 || ty < 0 || tx >= span() || ty >= span()) return false;
+		int bit = ty * span() + tx;
+		return (bits[(size_t(fromBlock.y) * blockCount.x + fromBlock.x) * bytesPerBlock + (bit >> 3)] >> (bit & 7)) & 1;
+	}
+
+	bool save(const std::string& path) const {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) return false;
+		PvsFileHeader header = { {'R','C','P','V'}, mapSize.x, mapSize.y, BLOCK_SIZE, radius, maxDistance };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)bits.data(), bits.size());
+		return (bool)file;
+	}
+
+	// Fails (and leaves the set empty) unless the file is for a map of mapSize and
+	// covers at least maxDistance.
+	bool load(const std::string& path, const olc::vi2d& mapSize, float maxDistance) {
+		clear();
+		std::ifstream file(path, std::ios::binary);
+		PvsFileHeader header{};
+		if (!file.read((char*)&header, sizeof(header)) || !std::equal(header.magic, header.magic + 4, "RCPV") || header.blockSize != BLOCK_SIZE
+			|| olc::vi2d(header.width, header.height) != mapSize || header.maxDistance < maxDistance) {
+			return false;
+		}
+		setLayout(mapSize, header.radius, header.maxDistance);
+		bits.resize(size_t(blockCount.x) * blockCount.y * bytesPerBlock);
+		if (!file.read((char*)bits.data(), bits.size())) {
+			clear();
+			return false;
+		}
+		return true;
+	}
+};
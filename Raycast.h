@@ -0,0 +1,298 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <vector>
+#include <limits>
+
+struct RaycastResult {
+	bool bHit;
+	float distance;
+	olc::vi2d cell;    // Cell that was hit, only meaningful when bHit
+	int cellType = 0;  // Full cell value, looked up once on the hit
+};
+
+// Any map type works as long as it provides:
+//   olc::vi2d size() const;
+//   bool isSolid(int x, int y) const;   (only called for in-bounds cells, this is the hot loop)
+//   int getCell(int x, int y) const;    (only called once, for the hit cell)
+template <typename Map>
+RaycastResult cast_ray(const olc::vf2d& start, const olc::vf2d& dir, const Map& map, float maxDistance = 100.0f) {
+	const olc::vi2d mapSize = map.size();
+	olc::vf2d unitHypotStep(sqrtf(1 + powf(dir.y / dir.x, 2.0f)), sqrtf(1 + powf(dir.x / dir.y, 2.0f)));
+	olc::vi2d unitStep;
+	olc::vf2d hypotLength(0, 0);
+	olc::vi2d mapCheck = start;
+
+	if (dir.x > 0) {
+		unitStep.x = 1;
+		hypotLength.x += (float(mapCheck.x+1) - start.x) * unitHypotStep.x;
+	}
+	else {
+		unitStep.x = -1;
+		hypotLength.x += (start.x - float(mapCheck.x)) * unitHypotStep.x;
+	}
+
+	if (dir.y > 0) {
+		unitStep.y = 1;
+		hypotLength.y += (float(mapCheck.y+1) - start.y) * unitHypotStep.y;
+	}
+	else {
+		unitStep.y = -1;
+		hypotLength.y += (start.y - float(mapCheck.y)) * unitHypotStep.y;
+	}
+
+	// An axis-aligned ray never crosses the other axis' cell boundaries
+	if (dir.x == 0) {
+		unitHypotStep.x = INFINITY;
+		hypotLength.x = INFINITY;
+	}
+	if (dir.y == 0) {
+		unitHypotStep.y = INFINITY;
+		hypotLength.y = INFINITY;
+	}
+
+	float distance = 0.0f;
+	bool bHit = false;
+	while (!bHit && distance < maxDistance) {
+		if (hypotLength.x < hypotLength.y) {
+			mapCheck.x += unitStep.x;
+			distance = hypotLength.x;
+			hypotLength.x += unitHypotStep.x;
+		}
+		else {
+			mapCheck.y += unitStep.y;
+			distance = hypotLength.y;
+			hypotLength.y += unitHypotStep.y;
+		}
+
+		if (mapCheck.x >= 0 && mapCheck.x < mapSize.x && mapCheck.y >= 0 && mapCheck.y < mapSize.y) {
+			if (map.isSolid(mapCheck.x, mapCheck.y)) {
+				bHit = true;
+			}
+		}
+	}
+
+	RaycastResult result = { bHit, distance, mapCheck };
+	if (bHit) {
+		result.cellType = map.getCell(mapCheck.x, mapCheck.y);
+	}
+	return result;
+}
+
+// Same result as cast_ray, but whenever the ray is inside an aligned block that
+// the occupancy pyramid reports as empty, it jumps straight to where it leaves
+// that block instead of stepping through every cell. Map must additionally
+// provide getOccupancy() returning an OccupancyPyramid (see GameMap.h).
+template <typename Map>
+RaycastResult cast_ray_hierarchical(const olc::vf2d& start, const olc::vf2d& dir, const Map& map, float maxDistance = 100.0f) {
+	static constexpr int skipLevels[] = { 2, 3, 6, 9 }; // log2 of 4x4, 8x8, 64x64 and 512x512 blocks
+	static constexpr float minSkipDistance = 8.0f;
+
+	const auto& occupancy = map.getOccupancy();
+	const olc::vi2d mapSize = map.size();
+	olc::vf2d unitHypotStep(sqrtf(1 + powf(dir.y / dir.x, 2.0f)), sqrtf(1 + powf(dir.x / dir.y, 2.0f)));
+	olc::vi2d unitStep;
+	olc::vf2d hypotLength(0, 0);
+	olc::vi2d mapCheck = start;
+
+	if (dir.x > 0) {
+		unitStep.x = 1;
+		hypotLength.x += (float(mapCheck.x+1) - start.x) * unitHypotStep.x;
+	}
+	else {
+		unitStep.x = -1;
+		hypotLength.x += (start.x - float(mapCheck.x)) * unitHypotStep.x;
+	}
+
+	if (dir.y > 0) {
+		unitStep.y = 1;
+		hypotLength.y += (float(mapCheck.y+1) - start.y) * unitHypotStep.y;
+	}
+	else {
+		unitStep.y = -1;
+		hypotLength.y += (start.y - float(mapCheck.y)) * unitHypotStep.y;
+	}
+
+	// An axis-aligned ray never crosses the other axis' cell boundaries. Kept
+	// finite so the block skip's crossing counts never multiply 0 by infinity.
+	if (dir.x == 0) {
+		unitHypotStep.x = std::numeric_limits<float>::max();
+		hypotLength.x = std::numeric_limits<float>::max();
+	}
+	if (dir.y == 0) {
+		unitHypotStep.y = std::numeric_limits<float>::max();
+		hypotLength.y = std::numeric_limits<float>::max();
+	}
+
+	// Number of cell boundaries (along one axis) the ray crosses before leaving the block
+	auto crossingsToExit = [](int cell, int step, int log2Size) {
+		int blockStart = (cell >> log2Size) << log2Size;
+		return step > 0 ? blockStart + (1 << log2Size) - cell : cell - blockStart + 1;
+	};
+
+	// Tries to advance the DDA state to the first cell outside the largest empty
+	// block around mapCheck, replaying the same x/y crossing order plain DDA would.
+	auto skipEmptyBlock = [&](float& distance) {
+		if (mapCheck.x < 0 || mapCheck.x >= mapSize.x || mapCheck.y < 0 || mapCheck.y >= mapSize.y) return false;
+
+		// Finest first: near walls the 4x4 test fails and we're back to plain DDA for the price of one mask.
+		if (!occupancy.blockEmpty(skipLevels[0], mapCheck.x, mapCheck.y)) return false;
+		int level = 0;
+		while (level + 1 < 4 && occupancy.blockEmpty(skipLevels[level + 1], mapCheck.x, mapCheck.y)) level++;
+
+		// Near maxDistance a big block would overshoot, so fall back to smaller ones.
+		for (; level >= 0; level--) {
+			int log2Size = skipLevels[level];
+			int nx = crossingsToExit(mapCheck.x, unitStep.x, log2Size);
+			int ny = crossingsToExit(mapCheck.y, unitStep.y, log2Size);
+			float exitX = hypotLength.x + (nx - 1) * unitHypotStep.x;
+			float exitY = hypotLength.y + (ny - 1) * unitHypotStep.y;
+
+			if (exitX < exitY) {
+				if (exitX >= maxDistance) continue;
+				int jy = hypotLength.y <= exitX ? std::min(ny - 1, int((exitX - hypotLength.y) / unitHypotStep.y) + 1) : 0;
+				mapCheck.x += nx * unitStep.x;
+				mapCheck.y += jy * unitStep.y;
+				hypotLength.x += nx * unitHypotStep.x;
+				hypotLength.y += jy * unitHypotStep.y;
+				distance = exitX;
+			}
+			else {
+				if (exitY >= maxDistance) continue;
+				int jx = hypotLength.x < exitY ? std::min(nx - 1, int(std::ceil((exitY - hypotLength.x) / unitHypotStep.x))) : 0;
+				mapCheck.x += jx * unitStep.x;
+				mapCheck.y += ny * unitStep.y;
+				hypotLength.x += jx * unitHypotStep.x;
+				hypotLength.y += ny * unitHypotStep.y;
+				distance = exitY;
+			}
+			return true;
+		}
+		return false;
+	};
+
+	// The finest emptiness test only changes when the ray enters another 4x4
+	// block, so skips are only tried then instead of on every step, and not
+	// at all in the last few cells where plain DDA is cheaper than the test.
+	olc::vi2d triedBlock(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+	float distance = 0.0f;
+	bool bHit = false;
+	while (!bHit && distance < maxDistance) {
+		olc::vi2d block(mapCheck.x >> skipLevels[0], mapCheck.y >> skipLevels[0]);
+		bool bSkipped = false;
+		if (block != triedBlock && maxDistance - distance > minSkipDistance) {
+			triedBlock = block;
+			bSkipped = skipEmptyBlock(distance);
+		}
+		if (!bSkipped) {
+			if (hypotLength.x < hypotLength.y) {
+				mapCheck.x += unitStep.x;
+				distance = hypotLength.x;
+				hypotLength.x += unitHypotStep.x;
+			}
+			else {
+				mapCheck.y += unitStep.y;
+				distance = hypotLength.y;
+				hypotLength.y += unitHypotStep.y;
+			}
+		}
+
+		if (mapCheck.x >= 0 && mapCheck.x < mapSize.x && mapCheck.y >= 0 && mapCheck.y < mapSize.y) {
+			if (map.isSolid(mapCheck.x, mapCheck.y)) {
+				bHit = true;
+			}
+		}
+	}
+
+	RaycastResult result = { bHit, distance, mapCheck };
+	if (bHit) {
+		result.cellType = map.getCell(mapCheck.x, mapCheck.y);
+	}
+	return result;
+}
+
+// Leaps through open space by the distance-field value of the current cell and
+// only walks cell by cell (short exact DDA segments) once it's close to a wall.
+// Map must additionally provide getDistanceField() (see GameMap.h).
+template <typename Map>
+RaycastResult cast_ray_distance_field(const olc::vf2d& start, const olc::vf2d& dir, const Map& map, float maxDistance = 100.0f) {
+	static constexpr float ddaSegment = 4.0f;
+
+	const auto& field = map.getDistanceField();
+	const olc::vi2d mapSize = map.size();
+	float travelled = 0.0f;
+	olc::vf2d pos = start;
+
+	// Outside the map everything is empty, so skip straight to where the ray enters it (if ever).
+	auto enterMap = [&]() {
+		float tNear = travelled, tFar = maxDistance;
+		for (int axis = 0; axis < 2; axis++) {
+			float o = axis ? start.y : start.x, d = axis ? dir.y : dir.x, hi = float(axis ? mapSize.y : mapSize.x);
+			if (d == 0) {
+				if (o < 0 || o >= hi) return false;
+				continue;
+			}
+			float t0 = (0 - o) / d, t1 = (hi - o) / d;
+			if (t0 > t1) std::swap(t0, t1);
+			tNear = std::max(tNear, t0);
+			tFar = std::min(tFar, t1);
+		}
+		if (tNear >= tFar) return false;
+		travelled = tNear;
+		pos = start + dir * travelled;
+		return true;
+	};
+
+	while (travelled < maxDistance) {
+		if ((pos.x < 0 || pos.x >= mapSize.x || pos.y < 0 || pos.y >= mapSize.y) && !enterMap()) {
+			return { false, maxDistance, pos };
+		}
+
+		while (pos.x >= 0 && pos.x < mapSize.x && pos.y >= 0 && pos.y < mapSize.y) {
+			float leap = field.leap(int(pos.x), int(pos.y));
+			if (leap < 1.0f) break;
+			travelled += leap;
+			if (travelled >= maxDistance) return { false, maxDistance, pos };
+			pos = start + dir * travelled;
+		}
+
+		RaycastResult result = cast_ray(pos, dir, map, std::min(ddaSegment, maxDistance - travelled));
+		result.distance += travelled;
+		if (result.bHit || result.distance >= maxDistance) return result;
+		travelled = result.distance;
+		pos = start + dir * travelled;
+	}
+	return { false, travelled, pos };
+}
+
+enum class RayBackend { DDA, Hierarchical, DistanceField };
+
+inline const char* rayBackendName(RayBackend backend) {
+	switch (backend) {
+	case RayBackend::Hierarchical: return "hierarchical DDA";
+	case RayBackend::DistanceField: return "distance field";
+	default: return "DDA";
+	}
+}
+
+template <typename Map>
+RaycastResult cast_ray(RayBackend backend, const olc::vf2d& start, const olc::vf2d& dir, const Map& map, float maxDistance = 100.0f) {
+	switch (backend) {
+	case RayBackend::Hierarchical: return cast_ray_hierarchical(start, dir, map, maxDistance);
+	case RayBackend::DistanceField: return cast_ray_distance_field(start, dir, map, maxDistance);
+	default: return cast_ray(start, dir, map, maxDistance);
+	}
+}
+
+// Adapter so plain vector<vector<int>> grids (e.g. RaycastDebug) can be cast against.
+struct GridRef {
+	const std::vector<std::vector<int>>& cells;
+	olc::vi2d mapSize;
+
+	olc::vi2d size() const { return mapSize; }
+	bool isSolid(int x, int y) const { return cells[y][x] > 0; }
+	int getCell(int x, int y) const { return cells[y][x]; }
+};
+
+inline RaycastResult cast_ray(const olc::vf2d& start, const olc::vf2d& dir, const std::vector<std::vector<int>>& gameMap, const olc::vi2d& mapSize, float maxDistance = 100.0f) {
+	return cast_ray(start, dir, GridRef{ gameMap, mapSize }, maxDistance);
+}
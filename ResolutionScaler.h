@@ -0,0 +1,68 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <algorithm>
+#include <cmath>
+
+// Picks the internal render resolution that keeps rendering inside a frame
+// time budget. Columns and rows are scaled separately: ray casting costs per
+// column while pixel fill costs per column and row, so the more of the time
+// goes into casting rays, the more of a change is taken from the columns.
+class ResolutionScaler {
+	olc::vi2d outputSize;
+	float budget;
+	float minScale;
+	olc::vf2d scale = { 1.0f, 1.0f };
+	float smoothedTime = 0.0f;
+	float smoothedRaycastShare = 0.5f;
+
+public:
+	// Resolutions are multiples of this, so tiny corrections don't cause a full redraw every frame
+	static constexpr int GRANULARITY = 8;
+
+	ResolutionScaler(const olc::vi2d& outputSize = { 0, 0 }, float budgetMs = 8.3f, float minScale = 0.25f)
+		: outputSize(outputSize), budget(budgetMs), minScale(minScale) {}
+
+	void setBudget(float budgetMs) { budget = budgetMs; }
+	float getBudget() const { return budget; }
+	olc::vf2d getScale() const { return scale; }
+
+	void reset() {
+		scale = { 1.0f, 1.0f };
+		smoothedTime = 0.0f;
+	}
+
+	olc::vi2d resolution() const {
+		auto axis = [](int size, float s) {
+			int scaled = int(std::round(size * s / GRANULARITY)) * GRANULARITY;
+			return std::min(size, std::max(GRANULARITY, scaled));
+		};
+		return { axis(outputSize.x, scale.x), axis(outputSize.y, scale.y) };
+	}
+
+	// Timings (ms) of a frame rendered completely at resolution(): the render
+	// stage's wall time, and the time spent in raycast and drawObjects.
+	// Returns true if resolution() changed.
+	bool addSample(float renderMs, float raycastMs, float objectsMs) {
+		olc::vi2d before = resolution();
+		smoothedTime = smoothedTime == 0.0f ? renderMs : smoothedTime * 0.8f + renderMs * 0.2f;
+		if (raycastMs + objectsMs > 0.0f) {
+			smoothedRaycastShare = smoothedRaycastShare * 0.8f + raycastMs / (raycastMs + objectsMs) * 0.2f;
+		}
+
+		// Hold while comfortably inside the budget, so the resolution doesn't oscillate around it
+		float ratio = budget / std::max(smoothedTime, 0.001f);
+		if (ratio >= 1.0f && ratio < 1.3f) return false;
+		if (ratio >= 1.0f && scale.x >= 1.0f && scale.y >= 1.0f) return false;
+
+		// Render time is roughly proportional to the pixel count
+		float areaFactor = std::max(0.7f, std::min(ratio * 0.95f, 1.1f));
+		float area = scale.x * scale.y * areaFactor;
+		float columnShare = 0.5f + 0.5f * smoothedRaycastShare;
+		scale.x = std::max(minScale, std::min(scale.x * std::pow(areaFactor, columnShare), 1.0f));
+		scale.y = std::max(minScale, std::min(area / scale.x, 1.0f));
+
+		if (resolution() == before) return false;
+		smoothedTime = 0.0f; // old samples were taken at the other resolution
+		return true;
+	}
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "GameMap.h"
+#include "Raycast.h"
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// What a light at origin can see: RAYS cast_rays spread evenly around it, each
+// keeping how far it got before hitting a wall (at most radius). A point is lit
+// when it's no further from origin than the walls in its direction.
+class ShadowMap {
+	olc::vf2d origin;
+	float radius;
+	std::vector<float> depth;
+
+public:
+	static constexpr int RAYS = 256;
+	static constexpr float BIAS = 0.01f;  // Points on the hit walls themselves must stay lit
+
+	template <typename Map>
+	ShadowMap(const Map& map, const olc::vf2d& origin, float radius) : origin(origin), radius(radius), depth(RAYS) {
+		for (int i = 0; i < RAYS; i++) {
+			float angle = (i + 0.5f) * 2.0f * 3.14159265f / RAYS;
+			RaycastResult hit = cast_ray(origin, olc::vf2d(cosf(angle), sinf(angle)), map, radius);
+			depth[i] = hit.bHit ? hit.distance : radius;
+		}
+	}
+
+	const olc::vf2d& getOrigin() const { return origin; }
+	float getRadius() const { return radius; }
+
+	// Takes the further of the two rays around point's direction, so walls seen
+	// at a grazing angle don't shadow themselves between rays
+	bool lit(const olc::vf2d& point) const {
+		olc::vf2d d = point - origin;
+		float t = (std::atan2(d.y, d.x) / (2.0f * 3.14159265f) + 1.0f) * RAYS - 0.5f;
+		int i = int(std::floor(t)) % RAYS;
+		return d.mag() <= std::max(depth[i], depth[(i + 1) % RAYS]) + BIAS;
+	}
+};
+
+// Shadow maps for moving lights, reused while a light stays in the same cell:
+// maps are cast from the centre of the light's cell, so a light's shadows only
+// change when it crosses into another cell (or the walls change). Holds at most
+// capacity maps and drops the least recently used ones past that. Maps are
+// shared, a dropped map stays valid for whoever still holds it.
+class ShadowCache {
+	struct Entry {
+		uint64_t key;
+		olc::vi2d cell;
+		float radius;
+		std::shared_ptr<const ShadowMap> map;
+	};
+
+	size_t capacity;
+	std::list<Entry> entries;  // Most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+
+	static uint64_t key(const olc::vi2d& cell, float radius) {
+		uint32_t radiusBits;
+		std::memcpy(&radiusBits, &radius, sizeof(radiusBits));
+		return ((uint64_t(uint32_t(cell.x)) * 0x9E3779B1u) ^ (uint64_t(uint32_t(cell.y)) << 32)) ^ (uint64_t(radiusBits) * 0x85EBCA77u);
+	}
+
+public:
+	static constexpr size_t DEFAULT_CAPACITY = 4096;  // About 4 MB of maps
+
+	ShadowCache(size_t capacity = DEFAULT_CAPACITY) : capacity(std::max<size_t>(1, capacity)) {}
+
+	size_t size() const { return entries.size(); }
+
+	// Map needs size(), isSolid() and getCell() like cast_ray's
+	template <typename Map>
+	std::shared_ptr<const ShadowMap> get(const Map& map, const olc::vf2d& pos, float radius) {
+		olc::vi2d cell(int(std::floor(pos.x)), int(std::floor(pos.y)));
+		uint64_t k = key(cell, radius);
+		auto found = index.find(k);
+		if (found != index.end() && found->second->cell == cell && found->second->radius == radius) {
+			entries.splice(entries.begin(), entries, found->second);
+			return found->second->map;
+		}
+		if (found != index.end()) {
+			entries.erase(found->second);
+			index.erase(found);
+		}
+
+		// The light can be anywhere in the cell, so the rays reach as far as it could from any of it
+		auto shadow = std::make_shared<const ShadowMap>(map, olc::vf2d(cell.x + 0.5f, cell.y + 0.5f), radius + 0.71f);
+		entries.push_front({ k, cell, radius, shadow });
+		index[k] = entries.begin();
+		if (entries.size() > capacity) {
+			index.erase(entries.back().key);
+			entries.pop_back();
+		}
+		return shadow;
+	}
+
+	// Cells in rect changed: drops the maps with rays that could pass through them
+	void invalidate(const MapRect& rect) {
+		for (auto it = entries.begin(); it != entries.end();) {
+			const ShadowMap& shadow = *it->map;
+			float nx = std::max(float(rect.min.x), std::min(float(rect.max.x), shadow.getOrigin().x));
+			float ny = std::max(float(rect.min.y), std::min(float(rect.max.y), shadow.getOrigin().y));
+			if ((olc::vf2d(nx, ny) - shadow.getOrigin()).mag() <= shadow.getRadius()) {
+				index.erase(it->key);
+				it = entries.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	void clear() {
+		entries.clear();
+		index.clear();
+	}
+};
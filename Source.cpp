@@ -1,6 +1,25 @@
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
+#include "Raycast.h"
+#include "ChunkedMap.h"
+#include "GameMap.h"
+#include "Minimap.h"
+#include "WorkerPool.h"
+#include "ResolutionScaler.h"
+#include "WallSegments.h"
+#include "PotentiallyVisibleSet.h"
+#include "TextureLoader.h"
+#include "TextureArray.h"
+#include "ColorMap.h"
+#include "Lightmap.h"
+#include "LightGrid.h"
+#include "Sweep.h"
+#include "Collision.h"
 #include <vector>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <atomic>
 using namespace std;
 
 
@@ -32,6 +51,9 @@ public:
 	}
 
 	virtual void update(float elapsedTime) {}
+
+	// Objects that light up their surroundings fill in light and return true
+	virtual bool getLight(PointLight&) const { return false; }
 };
 
 class MovingGameObject : public GameObject {
@@ -48,82 +70,82 @@ public:
 };
 
 class Fireball : public MovingGameObject {
-private:
-	const vector<vector<int>>& gameMap;
-	const olc::vi2d& gameSize;
 public:
-	Fireball(olc::Sprite* sprite, float x, float y, float vx, float vy, vector<vector<int>>& gameMap, olc::vi2d& gameSize) : MovingGameObject(sprite,x,y,vx,vy), gameMap(gameMap), gameSize(gameSize) {
+	Fireball(olc::Sprite* sprite, float x, float y, float vx, float vy) : MovingGameObject(sprite,x,y,vx,vy) {
 		scale = 0.3f;
 	}
 
-	void update(float elapsedTime) override {
-		MovingGameObject::update(elapsedTime);
-		if (pos.x < 0 || pos.x >= gameSize.x || pos.y < 0 || pos.y >= gameSize.y || gameMap[(int)pos.y][(int)pos.x] == 1) {
-			bRemoved = true;
-		}
+	static constexpr float LIGHT_RADIUS = 2.5f;
+	static constexpr float LIGHT_INTENSITY = 0.8f;
+
+	// Moved by Game::simulate, which sweeps every fireball against the map at once
+	void update(float) override {}
+
+	bool getLight(PointLight& light) const override {
+		light = { pos, LIGHT_RADIUS, LIGHT_INTENSITY };
+		return true;
 	}
 };
 
+// Short flash of light where a fireball hit a wall
+class ImpactFlash : public GameObject {
+	float age = 0;
 
-struct RaycastResult { bool bHit; float distance; }	cast_ray(const olc::vf2d& start, const olc::vf2d& dir, const std::vector<std::vector<int>>& gameMap, const olc::vi2d& mapSize, float maxDistance = 100.0f) {
-	olc::vf2d unitHypotStep(sqrtf(1 + powf(dir.y / dir.x, 2.0f)), sqrtf(1 + powf(dir.x / dir.y, 2.0f)));
-	olc::vi2d unitStep;
-	olc::vf2d hypotLength(0, 0);
-	olc::vi2d mapCheck = start;
+public:
+	static constexpr float LIFETIME = 0.2f;
+	static constexpr float LIGHT_RADIUS = 1.5f;
 
-	if (dir.x == 0) {
-		unitHypotStep.x = maxDistance;
-		hypotLength.x = maxDistance;
-	}
-	else if (dir.y == 0) {
-		unitHypotStep.y = maxDistance;
-		hypotLength.y = maxDistance;
+	ImpactFlash(olc::Sprite* sprite, const olc::vf2d& pos) : GameObject(sprite, pos.x, pos.y) {
+		scale = 0.15f;
 	}
 
-	if (dir.x > 0) {
-		unitStep.x = 1;
-		hypotLength.x += (float(mapCheck.x+1) - start.x) * unitHypotStep.x;
-	}
-	else {
-		unitStep.x = -1;
-		hypotLength.x += (start.x - float(mapCheck.x)) * unitHypotStep.x;
+	void update(float elapsedTime) override {
+		age += elapsedTime;
+		if (age >= LIFETIME) bRemoved = true;
 	}
 
-	if (dir.y > 0) {
-		unitStep.y = 1;
-		hypotLength.y += (float(mapCheck.y+1) - start.y) * unitHypotStep.y;
-	}
-	else {
-		unitStep.y = -1;
-		hypotLength.y += (start.y - float(mapCheck.y)) * unitHypotStep.y;
+	bool getLight(PointLight& light) const override {
+		light = { pos, LIGHT_RADIUS, 1.0f - age / LIFETIME };
+		return true;
 	}
+};
 
-	float distance = 0.0f;
-	bool bHit = false;
-	while (!bHit && distance < maxDistance) {
-		if (hypotLength.x < hypotLength.y) {
-			mapCheck.x += unitStep.x;
-			distance = hypotLength.x;
-			hypotLength.x += unitHypotStep.x;
-		}
-		else {
-			mapCheck.y += unitStep.y;
-			distance = hypotLength.y;
-			hypotLength.y += unitHypotStep.y;
-		}
+// Input sampled on the main thread for one simulation step
+struct FrameInput {
+	bool bForward, bBack, bTurnLeft, bTurnRight, bStrafeLeft, bStrafeRight, bFire;
+	bool bToggleWall, bWideEdit;
+};
 
-		if (mapCheck.x >= 0 && mapCheck.x < mapSize.x && mapCheck.y >= 0 && mapCheck.y < mapSize.y) {
-			if (gameMap[mapCheck.y][mapCheck.x] == 1) {
-				bHit = true;
-			}
-		}
-	}
+// Everything the renderer needs from one simulated frame. The simulation thread
+// fills one of these while the previous one is being rendered, and after that
+// it's only read, so simulation and rendering never share mutable state.
+struct FrameState {
+	struct ObjectView {
+		olc::Sprite* sprite;
+		olc::vf2d pos;
+		float scale;
+	};
+
+	// The map is read by both stages, so the simulation queues its edits here
+	// and they're applied in between frames.
+	struct MapEdit {
+		MapRect rect;  // Filled with value, clipped to the map
+		int value;
+	};
+
+	Player player;
+	std::vector<ObjectView> objects;
+	std::vector<MapEdit> mapEdits;
+
+	// Lights of the objects that have one, bucketed by the cells they reach
+	std::vector<PointLight> lights;
+	std::vector<std::shared_ptr<const ShadowMap>> shadows;  // Per light, null when it can't light the view
+	LightGrid lightGrid;
+};
 
-	return { bHit, distance };
-}
 
 class RaycastDebug : public olc::PixelGameEngine {
-	vector<vector<int>> field;
+	GameMap field = GameMap(olc::vi2d(0, 0));
 	int blockSize = 30;
 	int rows;
 	int cols;
@@ -141,7 +163,7 @@ class RaycastDebug : public olc::PixelGameEngine {
 			}
 		}*/
 
-		field = vector<vector<int>>(rows, vector<int>(cols, 0));
+		field = GameMap(olc::vi2d(cols, rows));
 		pPos.x = ScreenWidth() / 2;
 		pPos.y = ScreenHeight() / 2;
 
@@ -164,15 +186,16 @@ class RaycastDebug : public olc::PixelGameEngine {
 
 		for (int x = 0; x < cols; x++) {
 			for (int y = 0; y < rows; y++) {
-				if (field[y][x] == 1) {
+				if (field.isSolid(x, y)) {
 					FillRect({ x * blockSize,y * blockSize }, { blockSize,blockSize }, olc::BLUE);
 				}
 				DrawRect({ x*blockSize,y*blockSize }, { blockSize,blockSize }, olc::WHITE);
 			}
 		}
 
+		// Right mouse paints walls, with shift held it erases them
 		if (GetMouse(olc::Mouse::RIGHT).bHeld) {
-			field[GetMouseY()/blockSize][GetMouseX()/blockSize] = 1;
+			field.setCell(GetMouseX()/blockSize, GetMouseY()/blockSize, GetKey(olc::SHIFT).bHeld ? 0 : 1);
 		}
 
 		if (GetMouse(olc::Mouse::LEFT).bHeld) {
@@ -186,7 +209,7 @@ class RaycastDebug : public olc::PixelGameEngine {
 
 			std::cout << olc::vi2d(cols, rows).str() << ' ' << nPPos.str() << '\n';
 
-			auto result = cast_ray(nPPos, dir, field, olc::vi2d(cols,rows));
+			auto result = cast_ray(nPPos, dir, field);
 			
 			olc::vf2d end = dir * result.distance*blockSize + pPos;
 			DrawLine(pPos, end, olc::YELLOW);
@@ -206,7 +229,7 @@ class RaycastDebug : public olc::PixelGameEngine {
 class Game : public olc::PixelGameEngine
 {
 private:
-	vector<vector<int>> gameMap = {
+	GameMap gameMap = vector<vector<int>>{
 		{1,1,1,1,1,1,1},
 		{1,0,0,0,0,0,1},
 		{1,0,0,0,0,0,1},
@@ -220,8 +243,8 @@ private:
 	};
 	float* depthBuffer;
 
-	int H = gameMap.size();
-	int W = gameMap[0].size();
+	int H = gameMap.size().y;
+	int W = gameMap.size().x;
 	olc::vi2d gameSize = olc::vi2d(W, H);
 
 	float FOV = 3.14 / 4;
@@ -229,21 +252,159 @@ private:
 	float rayCount = 100;
 	float deltaFOV = FOV / rayCount;
 	float MAX_DISTANCE = 16;
-
-	olc::Sprite* wallTexture;
+	static constexpr float PLAYER_RADIUS = 0.2f;  // Walls stop the player this far from its position
+	static constexpr float WALL_REACH = 1.5f;     // How far away the T key knocks out walls
+	RayBackend rayBackend = RayBackend::DDA;
+
+	// Set when the level is streamed from a chunk file instead of the built-in gameMap
+	std::string worldFile;
+	ChunkedMap* world = nullptr;
+
+	// Wall span mode draws gameMap's walls from wallSegments instead of casting a
+	// ray per column. Streamed worlds always cast rays.
+	WallSegments wallSegments;
+	bool bWallSpans = false;
+
+	// Which 4x4 blocks can be seen from which, for rejecting objects before projecting them.
+	// Only valid while the map is static: precomputed for gameMap, loaded from
+	// worldFile + ".pvs" for streamed worlds, and dropped on the first map edit.
+	PotentiallyVisibleSet pvs;
+
+	// Decoded on loadPool while the game already runs, placeholders until then.
+	// Decoded images are kept in textureCache, later runs map them instead.
+	static constexpr const char* TEXTURE_CACHE_DIR = "texture_cache";
+	WorkerPool* loadPool = nullptr;
+	TextureCache textureCache = TextureCache(TEXTURE_CACHE_DIR);
+	TextureLoader* textures = nullptr;
 	olc::Sprite* lampTexture;
 	olc::Sprite* fireballTexture;
 
+	// Every non-zero cell is a wall; cell value n is drawn with layer (n - 1) % layers()
+	// of wallArray, which holds WALL_TEXTURE_FILES and is rebuilt as they finish loading
+	static constexpr const char* WALL_TEXTURE_FILES[] = { "wall_texture_adj.JPG" };
+	std::vector<olc::Sprite*> wallTextures;
+	TextureArray wallArray;
+	bool bPalettizedWalls = true;  // 8-bit texels through a palette per wall texture
+	// Walls are drawn in true colour until their palettized copy, made on loadPool, is swapped in
+	std::shared_ptr<TextureArray> palettizedWalls;
+	std::future<void> wallPalettize;
+
+	// Walls fade into FOG_COLOR from FOG_START to MAX_DISTANCE. Palettized walls use
+	// wallColorMaps, ColorMap::LEVELS shaded copies of each layer's palette.
+	static constexpr float FOG_START = 2.0f;
+	const olc::Pixel FOG_COLOR = olc::BLACK;
+	ColorMap colorMap;
+	std::vector<olc::Pixel> wallColorMaps;
+	bool bFog = true;
+
+	// Lamps are drawn as sprites and lit walls through lightmap, baked from them as
+	// static lights; walls no lamp reaches get AMBIENT_LIGHT. The bake for gameMap is
+	// cached in LIGHTMAP_FILE, streamed worlds load worldFile + ".lightmap" (see --lightmap).
+	static constexpr const char* LIGHTMAP_FILE = "level.lightmap";
+	static constexpr float LAMP_RADIUS = 4.0f;
+	static constexpr float AMBIENT_LIGHT = 0.3f;
+	const std::vector<olc::vf2d> LAMP_POSITIONS = { { 3, 3 }, { 4, 4 } };
+	Lightmap lightmap;
+	bool bLighting = true;
+
+	// Moving lights of the frame being rendered, added to the lightmap's. Their
+	// shadows come from shadowCache, which only the simulation uses.
+	const LightGrid* frameLights = nullptr;
+	ShadowCache shadowCache;
+	bool bShadows = true;
+
 	std::vector<GameObject*> gameObjects;
 
+	// Fireball movements of one simulation step, swept against the map together
+	std::vector<olc::vf2d> sweepFrom;
+	std::vector<olc::vf2d> sweepTo;
+	std::vector<SweepHit> sweepHits;
+
+	// Frame N is rendered on renderPool from frames[renderFrame] while frame N+1
+	// is simulated on simThread into the other one
+	WorkerPool* renderPool = nullptr;
+	WorkerPool* simThread = nullptr;
+	FrameState frames[2];
+	int renderFrame = 0;
+	std::vector<std::future<void>> renderJob;
+	std::future<void> simulation;
+
+	// Frames are rendered into one back buffer while the previous one is uploaded
+	// and presented as decals, so rendering never waits for the texture copy.
+	// Each buffer is split into TILE_WIDTH wide column tiles with a decal each
+	// and remembers what it shows, so only the tiles that changed are rendered
+	// and uploaded again.
+	static constexpr int BACK_BUFFERS = 2;
+	static constexpr int TILE_SHIFT = 5;
+	static constexpr int TILE_WIDTH = 1 << TILE_SHIFT;
+
+	struct BackBuffer {
+		std::vector<olc::Sprite*> tiles;
+		std::vector<olc::Decal*> tileDecals;
+		std::vector<char> dirty;
+		std::vector<int> dirtyTiles;              // Tiles the last renderJob into this buffer redrew
+		std::vector<RaycastResult> columnHits;    // Per screen column, reused by the minimap's FOV rays
+
+		// What the tiles currently show
+		bool bValid = false;
+		Player player;
+		std::vector<FrameState::ObjectView> objects;
+		std::vector<PointLight> lights;
+		uint32_t mapVersion = 0;
+		RayBackend backend;
+		bool bWallSpans = false;
+		olc::vi2d resolution;     // Columns and rows actually rendered, from the top-left of the tiles
+		bool bReconstructed = false;  // Some columns were reprojected rather than cast
+	};
+
+	BackBuffer backBuffers[BACK_BUFFERS];
+	int backBuffer = 0;         // Being rendered into by renderJob
+	BackBuffer* renderTarget = nullptr;
+
+	// Internal resolution of the frame renderJob is drawing. The tiles are allocated
+	// at the output size and only their top-left part is used, the decals scale it up.
+	olc::vi2d renderSize;
+	ResolutionScaler scaler;
+	bool bDynamicResolution = true;
+
+	// Timings of the last renderJob, in nanoseconds; renderEnd is relative to renderStart
+	std::chrono::steady_clock::time_point renderStart;
+	std::atomic<int64_t> renderEnd{ 0 };
+	std::atomic<int64_t> raycastTime{ 0 };
+	std::atomic<int64_t> objectsTime{ 0 };
+
+	// Interleaved mode casts only the even or the odd columns (interleaveParity,
+	// alternating) while the camera moves slowly and reprojects the others from
+	// previousFrame. -1 renders every column.
+	static constexpr float INTERLEAVE_MAX_TURN = 8.0f;     // In columns per frame
+	static constexpr float INTERLEAVE_MAX_MOVE = 0.1f;     // In cells per frame
+	bool bInterleaved = false;
+
+	// Adaptive mode casts every ADAPTIVE_STEP-th column and only subdivides where hits differ
+	static constexpr int ADAPTIVE_STEP = 8;
+	bool bAdaptive = false;
+	int interleaveParity = -1;
+	int interleaveFrame = 0;
+	const BackBuffer* previousFrame = nullptr;
+
+	// Bumped whenever map contents change, which makes every back buffer stale
+	uint32_t mapVersion = 0;
+	uint32_t worldGeneration = 0;
+
+	// Player-centred minimap; its wall layer is only redrawn when the view or the cells under it change
+	static constexpr int MINIMAP_SIZE = 160;
+	Minimap* minimap = nullptr;
+	olc::Decal* minimapDecal = nullptr;
+
 	void Draw(int x, int y, const olc::Pixel& color, float distance) {
-		if (x < 0 || x >= ScreenWidth() || y<0 || y>=ScreenHeight()) {
+		if (x < 0 || x >= renderSize.x || y<0 || y>=renderSize.y) {
 			return;
 		}
 
-		if (depthBuffer[y * ScreenWidth() + x] > distance) {
-			depthBuffer[y * ScreenWidth() + x] = distance;
-			olc::PixelGameEngine::Draw(x, y, color);
+		if (depthBuffer[y * renderSize.x + x] > distance) {
+			depthBuffer[y * renderSize.x + x] = distance;
+			olc::Sprite* tile = renderTarget->tiles[x >> TILE_SHIFT];
+			tile->GetData()[y * tile->width + (x & (TILE_WIDTH - 1))] = color;
 		}
 	}
 
@@ -258,50 +419,172 @@ private:
 		return fractX < 0.1 || fractX > 0.9 || fractY < 0.1 || fractY > 0.9;
 	}
 
-	void drawMap() {
-		for (int x = 0; x < W; x++) {
-			for (int y = 0; y < H; y++) {
-				if (gameMap[y][x] == 1) {
-					DrawRect(olc::vi2d(x * 10, y * 10), olc::vi2d(10, 10));
-				}
-			}
+	bool isWall(int x, int y) const {
+		return world ? world->isSolid(x, y) : gameMap.isSolid(x, y);
+	}
+
+	bool useWallSpans() const {
+		return bWallSpans && !world;
+	}
+
+	RaycastResult castRay(const olc::vf2d& start, const olc::vf2d& dir) const {
+		if (world) {
+			return cast_ray(start, dir, *world, MAX_DISTANCE);
+		}
+		return cast_ray(rayBackend, start, dir, gameMap, MAX_DISTANCE);
+	}
+
+	// Drawn with decals over the back buffer tiles, so it never dirties them
+	void drawMap(const BackBuffer& buffer) {
+		const Player& player = buffer.player;
+		if (minimap->update({ player.x, player.y }, gameSize, [this](int x, int y) { return isWall(x, y); }, world ? nullptr : &gameMap.getOccupancy())) {
+			minimapDecal->Update();
 		}
+		DrawDecal(olc::vf2d(0, 0), minimapDecal);
 
-		DrawRect(olc::vi2d(player.x * 10, player.y * 10), olc::vi2d(3, 3), olc::GREEN);
+		olc::vf2d center = minimap->toMinimap({ player.x, player.y });
+		float scale = minimap->pixelsPerCell();
+		auto drawClipped = [&](olc::vf2d a, olc::vf2d b) {
+			if (minimap->clip(a, b)) DrawLineDecal(a, b, olc::GREEN);
+		};
 
-		DrawLine(olc::vi2d(player.x * 10, player.y * 10), olc::vi2d(cosf(player.angle - HFOV)*15 + player.x*10, sinf(player.angle - HFOV)*15 + player.y*10), olc::GREEN);
-		DrawLine(olc::vi2d(player.x * 10, player.y * 10), olc::vi2d(cosf(player.angle + HFOV)*15 + player.x*10, sinf(player.angle + HFOV)*15 + player.y*10), olc::GREEN);
+		DrawRectDecal(center, olc::vf2d(3, 3), olc::GREEN);
 
-		float a = player.angle - HFOV;
+		drawClipped(center, center + olc::vf2d(cosf(player.angle - HFOV), sinf(player.angle - HFOV)) * 15);
+		drawClipped(center, center + olc::vf2d(cosf(player.angle + HFOV), sinf(player.angle + HFOV)) * 15);
+
+		// FOV rays come from the columns raycast() cast for this buffer
 		for (int i = 0; i < rayCount; i++) {
-			RaycastResult result = shootRay(a);
+			int column = int(i * buffer.resolution.x / rayCount);
+			const RaycastResult& result = buffer.columnHits[column];
 			if (result.bHit) {
-				//cout << "yes " <<  result.distance << ' ' << i << endl;
-				DrawLine(olc::vi2d(player.x * 10, player.y * 10), olc::vi2d(cosf(a) * result.distance*10 + player.x * 10, sinf(a) * result.distance*10 + player.y * 10), olc::GREEN);
+				float a = column / ((float)buffer.resolution.x) * FOV - HFOV + player.angle;
+				drawClipped(center, center + olc::vf2d(cosf(a), sinf(a)) * result.distance * scale);
 			}
-			a += deltaFOV;
 		}
 		//DrawCircle()
 
-		for (GameObject* obj : gameObjects) {
-			FillCircle(obj->pos*10, 2, olc::RED);
+		for (const FrameState::ObjectView& obj : buffer.objects) {
+			olc::vf2d pos = minimap->toMinimap(obj.pos);
+			if (minimap->contains(pos)) {
+				FillRectDecal(pos - olc::vf2d(2, 2), olc::vf2d(5, 5), olc::RED);
+			}
 		}
 	}
 
-	RaycastResult shootRay(float angle) {
-		return cast_ray(olc::vf2d(player.x, player.y), olc::vf2d(cosf(angle), sinf(angle)), gameMap, olc::vi2d(W, H), MAX_DISTANCE);
+	RaycastResult castColumn(int x, const Player& player) const {
+		float angle = x / ((float)renderSize.x) * FOV - HFOV + player.angle;
+		return castRay(olc::vf2d(player.x, player.y), olc::vf2d(cosf(angle), sinf(angle)));
+	}
+
+	// Which face of `cell` a point on its border lies on: 0/1 = low/high x, 2/3 = low/high y
+	static int faceOf(const olc::vf2d& point, const olc::vi2d& cell) {
+		float faces[4] = { std::abs(point.x - cell.x), std::abs(point.x - cell.x - 1), std::abs(point.y - cell.y), std::abs(point.y - cell.y - 1) };
+		return int(std::min_element(faces, faces + 4) - faces);
 	}
 
+	// Pointing out of the cell, away from the wall
+	static olc::vf2d faceNormal(int face) {
+		return face < 2 ? olc::vf2d(face == 0 ? -1.0f : 1.0f, 0.0f) : olc::vf2d(0.0f, face == 2 ? -1.0f : 1.0f);
+	}
+
+	olc::vf2d hitPoint(int x, const Player& player, int columns, const RaycastResult& ray) const {
+		float angle = x / ((float)columns) * FOV - HFOV + player.angle;
+		return olc::vf2d(player.x, player.y) + olc::vf2d(cosf(angle), sinf(angle)) * ray.distance;
+	}
+
+	// Intersects column x's ray with one face of `hit`'s cell. Fails if the ray
+	// misses that face or would see it from inside the cell.
+	bool intersectFace(int x, const Player& player, const RaycastResult& hit, int face, RaycastResult& out) const {
+		float angle = x / ((float)renderSize.x) * FOV - HFOV + player.angle;
+		int axis = face / 2;
+		float plane = float((axis ? hit.cell.y : hit.cell.x) + face % 2);
+
+		olc::vf2d start(player.x, player.y), dir(cosf(angle), sinf(angle));
+		float o = axis ? start.y : start.x, d = axis ? dir.y : dir.x;
+		if (face % 2 == 0 ? (o >= plane || d <= 0) : (o <= plane || d >= 0)) return false;
+		float t = (plane - o) / d;
+		float along = axis ? start.x + dir.x * t : start.y + dir.y * t;
+		int cellAlong = axis ? hit.cell.x : hit.cell.y;
+		if (along < cellAlong || along > cellAlong + 1) return false;
+
+		out = { true, t, hit.cell, hit.cellType };
+		return true;
+	}
+
+	// Rebuilds column x's hit without a ray: finds the wall face the previous frame
+	// saw in this direction and intersects this column's ray with it. Fails when the
+	// ray misses that face, or when either neighbouring column cast this frame is
+	// missing or hit a different cell (there may be an edge in between).
+	bool reprojectColumn(int x, const Player& player, const BackBuffer& previous, const RaycastResult* left, const RaycastResult* right, RaycastResult& out) const {
+		float angle = x / ((float)renderSize.x) * FOV - HFOV + player.angle;
+		int px = (int)std::round((angle - previous.player.angle + HFOV) / FOV * renderSize.x);
+		if (px < 0 || px >= previous.resolution.x) return false;
+		const RaycastResult& prev = previous.columnHits[px];
+		if (!prev.bHit) return false;
+		for (const RaycastResult* neighbour : { left, right }) {
+			if (!neighbour || !neighbour->bHit || neighbour->cell != prev.cell) return false;
+		}
+		int face = faceOf(hitPoint(px, previous.player, previous.resolution.x, prev), prev.cell);
+		return intersectFace(x, player, prev, face, out);
+	}
 
-	void drawWall(int x) {
-		float angle = x / ((float)ScreenWidth()) * FOV - HFOV + player.angle;
+	// Fills hits for columns first, first + step, ... below x1. Adaptive mode only
+	// casts every ADAPTIVE_STEP-th of them; where two neighbouring casts hit the
+	// same face of the same cell the columns between are intersected with that
+	// face directly, elsewhere the span is halved until the edge is found.
+	// Interleaved frames cast every column they own: reprojection checks the
+	// columns between against them, so those have to be real hits.
+	void castColumns(const Player& player, int first, int x1, int step, std::vector<RaycastResult>& hits) {
+		if (!bAdaptive || interleaveParity >= 0) {
+			for (int x = first; x < x1; x += step) {
+				hits[x] = castColumn(x, player);
+			}
+			return;
+		}
+
+		int last = first + (x1 - 1 - first) / step * step;
+		hits[first] = castColumn(first, player);
+		for (int a = first; a < last;) {
+			int b = std::min(a + ADAPTIVE_STEP * step, last);
+			hits[b] = castColumn(b, player);
+			refineColumns(player, a, b, step, hits);
+			a = b;
+		}
+	}
+
+	// hits[a] and hits[b] are cast, fills in the columns between them
+	void refineColumns(const Player& player, int a, int b, int step, std::vector<RaycastResult>& hits) {
+		if (b - a <= step) return;
+
+		const RaycastResult& ha = hits[a];
+		const RaycastResult& hb = hits[b];
+		if (ha.bHit && hb.bHit && ha.cell == hb.cell) {
+			int face = faceOf(hitPoint(a, player, renderSize.x, ha), ha.cell);
+			if (face == faceOf(hitPoint(b, player, renderSize.x, hb), hb.cell)) {
+				for (int x = a + step; x < b; x += step) {
+					if (!intersectFace(x, player, ha, face, hits[x])) {
+						hits[x] = castColumn(x, player);
+					}
+				}
+				return;
+			}
+		}
+
+		int mid = a + (b - a) / step / 2 * step;
+		hits[mid] = castColumn(mid, player);
+		refineColumns(player, a, mid, step, hits);
+		refineColumns(player, mid, b, step, hits);
+	}
+
+	void drawWall(int x, const Player& player, const RaycastResult& ray) {
+		float angle = x / ((float)renderSize.x) * FOV - HFOV + player.angle;
 		olc::vf2d direction(cosf(angle), sinf(angle));
 		olc::vf2d rayStart(player.x, player.y);
-		RaycastResult ray = cast_ray(rayStart, direction, gameMap, { W,H }, MAX_DISTANCE);
 		//std::cout << ray.distance << '|' << angle << "RAy\n";
-		float delta = (float)ScreenHeight() / ray.distance / 2;
-		int ceiling = (float)ScreenHeight() / 2 - delta;
-		int floor = (float)ScreenHeight() / 2 + delta;
+		float delta = (float)renderSize.y / ray.distance / 2;
+		int ceiling = (float)renderSize.y / 2 - delta;
+		int floor = (float)renderSize.y / 2 + delta;
 
 		
 		for (int y = 0; y < ceiling; y++) {
@@ -326,77 +609,518 @@ private:
 		else {
 			textureOffset = (hitPoint.y - (int)hitPoint.y);
 		}
-
-		for (int y = std::max(0,ceiling); y < std::min(ScreenHeight(),floor); y++) {
-			olc::Pixel wallColor = wallTexture->Sample(textureOffset, (y - ceiling) / (float)(floor - ceiling));
-			Draw(x, y, wallColor, ray.distance);
+		int face = faceOf(hitPoint, ray.cell);
+
+		// From the mip level that fits the wall's height on screen
+		int layer = std::max(0, ray.cellType - 1) % wallArray.layers();
+		int level = wallArray.levelFor(wallArray.size().y / (float)std::max(1, floor - ceiling));
+		olc::vi2d size = wallArray.size(level);
+		int u = std::min(int(textureOffset * size.x), size.x - 1);
+		float brightness = bLighting ? lightmap.brightness(ray.cell, face, textureOffset) : 1.0f;
+		if (bLighting) {
+			brightness = std::min(1.0f, brightness + frameLights->brightness(ray.cell, hitPoint, faceNormal(face)));
+		}
+		int light = colorMap.levelFor(bFog ? ray.distance : 0.0f, brightness);
+		if (wallArray.isPalettized()) {
+			const uint8_t* indices = wallArray.indexColumn(layer, level, u);
+			const olc::Pixel* palette = &wallColorMaps[(size_t(layer) * ColorMap::LEVELS + light) * TextureArray::PALETTE_SIZE];
+			for (int y = std::max(0, ceiling); y < std::min(renderSize.y, floor); y++) {
+				Draw(x, y, palette[indices[std::min(int((y - ceiling) / (float)(floor - ceiling) * size.y), size.y - 1)]], ray.distance);
+			}
+		}
+		else {
+			const olc::Pixel* texels = wallArray.column(layer, level, u);
+			for (int y = std::max(0, ceiling); y < std::min(renderSize.y, floor); y++) {
+				Draw(x, y, colorMap.shade(texels[std::min(int((y - ceiling) / (float)(floor - ceiling) * size.y), size.y - 1)], light), ray.distance);
+			}
 		}
 
-		for (int y = floor; y < ScreenHeight(); y++) {
+		for (int y = floor; y < renderSize.y; y++) {
 			Draw(x, y, olc::DARK_RED, ray.distance);
 		}
 	}
 
-	void raycast() {
-		for (int x = 0; x < ScreenWidth(); x++) {
-			drawWall(x);
+	void raycast(const Player& player, int x0, int x1) {
+		std::vector<RaycastResult>& hits = renderTarget->columnHits;
+		if (useWallSpans()) {
+			wallSegments.render({ player.x, player.y }, player.angle, FOV, renderSize.x, x0, x1, MAX_DISTANCE, hits);
+		}
+		else if (interleaveParity < 0) {
+			castColumns(player, x0, x1, 1, hits);
+		}
+		else if (x0 + 1 < x1 || (x0 & 1) == interleaveParity) {
+			castColumns(player, (x0 & 1) == interleaveParity ? x0 : x0 + 1, x1, 2, hits);
+		}
+
+		// Interleaved frames fill in the other columns from the previous frame,
+		// only using neighbours from this strip since other strips run concurrently.
+		// Columns at the strip's ends lack a neighbour and are always cast.
+		if (interleaveParity >= 0) {
+			for (int x = (x0 & 1) == interleaveParity ? x0 + 1 : x0; x < x1; x += 2) {
+				const RaycastResult* left = x > x0 ? &hits[x - 1] : nullptr;
+				const RaycastResult* right = x + 1 < x1 ? &hits[x + 1] : nullptr;
+				if (!reprojectColumn(x, player, *previousFrame, left, right, hits[x])) {
+					hits[x] = castColumn(x, player);
+				}
+			}
+		}
+
+		for (int x = x0; x < x1; x++) {
+			for (int y = 0; y < renderSize.y; y++) {
+				depthBuffer[y * renderSize.x + x] = 1000.0f;
+			}
+			drawWall(x, player, hits[x]);
 			//std::cout << x << "DRAWN COL\n";
 		}
 	}
 
-	void drawObjects() {
+	// Where drawObjects() puts an object on screen
+	struct ObjectSpan {
+		int left, top, width, height;
+		float distance;
+	};
+
+	// Returns false when the object is out of view
+	bool projectObject(const Player& player, const FrameState::ObjectView& obj, ObjectSpan& span) const {
+		if (!pvs.visible(olc::vi2d(int(player.x), int(player.y)), olc::vi2d(obj.pos))) {
+			return false;
+		}
+
+		//olc::vf2d pPos(player.x, player.y);
+		//float angleToX = std::atan2(obj.pos.x - player.x, obj.pos.y - player.y);
+		float angle = -std::atan2f(sinf(player.angle), cosf(player.angle)) + std::atan2f(obj.pos.y - player.y, obj.pos.x - player.x);
+		if (angle > PI) {
+			angle -= 2 * PI;
+		}
+		else if (angle < -PI) {
+			angle += 2 * PI;
+		}
+
+		float distance = (olc::vf2d(player.x, player.y) - obj.pos).mag();
+		//float distance = sqrtf(powf(player.x - obj.pos.x, 2) + powf(player.y - obj.pos.y, 2.0f));
+
+		if (angle < -HFOV || angle > HFOV || distance <= 0.5f) {
+			return false;
+		}
+
+		float delta = renderSize.y / distance / 2 * obj.scale;
+		int top = (float)renderSize.y / 2 - delta;
+		/*int bottom = (float)renderSize.y / 2 + delta;*/
+		int bottom = renderSize.y - top;
+		int height = bottom - top;
+		float aspectRatio = (float)obj.sprite->width / obj.sprite->height;
+		int width = aspectRatio * height;
+		// angle = x/ScreenWidth * FOV - HFOV + player.angle
+		int midx = (angle + HFOV)/FOV * renderSize.x;
+		span = { midx - width / 2, top, width, height, distance };
+		return true;
+	}
+
+	// Only draws the part of each object inside columns [x0, x1), so column strips can be drawn in parallel
+	void drawObjects(const FrameState& frame, int x0, int x1) {
 		//olc::vf2d playerLookDir = player.getLookDir();
 		//olc::vf2d playerPos(player.x, player.y);
 		//float pAngleRmdr = fmodf(player.angle, 2*PI);
 
-		for (GameObject* obj : gameObjects) {
-			//olc::vf2d pPos(player.x, player.y);
-			//float angleToX = std::atan2(obj->pos.x - player.x, obj->pos.y - player.y);
-			float angle = -std::atan2f(sinf(player.angle), cosf(player.angle)) + std::atan2f(obj->pos.y - player.y, obj->pos.x - player.x);
-			float temp = angle;
-			if (angle > PI) {
-				angle -= 2 * PI;
+		for (const FrameState::ObjectView& obj : frame.objects) {
+			ObjectSpan span;
+			if (!projectObject(frame.player, obj, span)) {
+				continue;
 			}
-			else if (angle < -PI) {
-				angle += 2 * PI;
+
+			for (int x = std::max(0, x0 - span.left); x < std::min(span.width, x1 - span.left); x++) {
+				float u = (float)x / span.width;
+				for (int y = 0; y < span.height; y++) {
+					float v = (float)y / span.height;
+					olc::Pixel color = obj.sprite->Sample(u, v);
+					if (color.a > 0)
+						Draw(span.left + x, span.top + y, color, span.distance);
+				}
 			}
-			//std::cout << angle << ' ' << temp << endl;
-			
-			float distance = (olc::vf2d(player.x, player.y) - obj->pos).mag();
-			//float distance = sqrtf(powf(player.x - obj->pos.x, 2) + powf(player.y - obj->pos.y, 2.0f));
-			
-			if (angle >= -HFOV && angle <= HFOV && distance > 0.5f) {
-				float delta = ScreenHeight() / distance / 2 * obj->scale;
-				int top = (float)ScreenHeight() / 2 - delta;
-				/*int bottom = (float)ScreenHeight() / 2 + delta;*/
-				int bottom = ScreenHeight() - top;
-				int height = bottom - top;
-				float aspectRatio = (float)obj->sprite->width / obj->sprite->height;
-				int width = aspectRatio * height;
-				// angle = x/ScreenWidth * FOV - HFOV + player.angle
-				int midx = (angle + HFOV)/FOV * ScreenWidth();
-				int left = midx - width / 2;
-
-				for (int x = 0; x < width; x++) {
-					float u = (float)x / width;
-					for (int y = 0; y < height; y++) {
-						float v = (float)y / height;
-						olc::Pixel color = obj->sprite->Sample(u, v);
-						if (color.a > 0)
-							Draw(left + x, top + y, color, distance);
+		}
+	}
+
+	void buildWallArray() {
+		std::vector<const olc::Sprite*> sprites(wallTextures.begin(), wallTextures.end());
+		std::vector<std::shared_ptr<const MappedTexture>> mapped;
+		for (olc::Sprite* sprite : wallTextures) mapped.push_back(textures->mapped(sprite));
+		wallArray.build(sprites, mapped);
+		wallColorMaps.clear();
+
+		// A copy that an older palettize still running is working on is simply dropped
+		palettizedWalls = nullptr;
+		if (bPalettizedWalls) {
+			std::shared_ptr<TextureArray> palettized = std::make_shared<TextureArray>(wallArray);
+			wallPalettize = loadPool->submit([palettized] { palettized->palettize(); });
+			palettizedWalls = palettized;
+		}
+	}
+
+	// At the sync point: swaps in the palettized walls once loadPool is done with them
+	bool swapInPalettizedWalls() {
+		if (!palettizedWalls || wallPalettize.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		wallPalettize.get();
+		wallArray = std::move(*palettizedWalls);
+		palettizedWalls = nullptr;
+		for (int layer = 0; layer < wallArray.layers(); layer++) {
+			colorMap.shadePalette(wallArray.palette(layer), TextureArray::PALETTE_SIZE, wallColorMaps);
+		}
+		return true;
+	}
+
+	std::vector<StaticLight> lampLights() const {
+		std::vector<StaticLight> lights;
+		for (const olc::vf2d& pos : LAMP_POSITIONS) {
+			lights.push_back({ pos, LAMP_RADIUS, 1.0f });
+		}
+		return lights;
+	}
+
+	// Uses the cached bake when its cells still match gameMap's, otherwise bakes and caches it again
+	void loadLighting() {
+		lightmap.setLights(lampLights(), AMBIENT_LIGHT);
+		if (world) {
+			if (!lightmap.load(worldFile + ".lightmap", world->size())) {
+				std::cout << "No lighting for " << worldFile << ", walls are unlit (see --lightmap)\n";
+			}
+			return;
+		}
+		if (lightmap.load(LIGHTMAP_FILE, gameMap.size()) && lightmap.getCellHash() == lightmap.hashCells(gameMap)) {
+			return;
+		}
+		WorkerPool pool;
+		lightmap.bake(gameMap, &pool);
+		if (!lightmap.save(LIGHTMAP_FILE)) {
+			std::cout << "Could not write " << LIGHTMAP_FILE << '\n';
+		}
+	}
+
+	// Decides which tiles of `buffer` have to be re-rendered to show `frame`. A
+	// different view (camera, map, ray backend, moving lights) dirties everything; otherwise only
+	// the columns covered by sprites that moved, before and after, are redrawn.
+	void markDirtyTiles(BackBuffer& buffer, const FrameState& frame) {
+		int tileCount = (renderSize.x + TILE_WIDTH - 1) >> TILE_SHIFT;
+		bool bViewChanged = !buffer.bValid || buffer.bReconstructed || buffer.mapVersion != mapVersion || buffer.backend != rayBackend || buffer.bWallSpans != useWallSpans() || buffer.resolution != renderSize
+			|| buffer.player.x != frame.player.x || buffer.player.y != frame.player.y || buffer.player.angle != frame.player.angle
+			|| !std::equal(buffer.lights.begin(), buffer.lights.end(), frame.lights.begin(), frame.lights.end(), [](const PointLight& a, const PointLight& b) {
+				return a.pos == b.pos && a.radius == b.radius && a.intensity == b.intensity;
+			});
+		buffer.dirty.assign(tileCount, bViewChanged ? 1 : 0);
+
+		if (!bViewChanged) {
+			auto sameObject = [](const FrameState::ObjectView& a, const FrameState::ObjectView& b) {
+				return a.sprite == b.sprite && a.pos == b.pos && a.scale == b.scale;
+			};
+			auto markMoved = [&](const std::vector<FrameState::ObjectView>& objects, const std::vector<FrameState::ObjectView>& others) {
+				for (const FrameState::ObjectView& obj : objects) {
+					if (std::any_of(others.begin(), others.end(), [&](const FrameState::ObjectView& other) { return sameObject(obj, other); })) {
+						continue;
+					}
+					ObjectSpan span;
+					if (projectObject(frame.player, obj, span) && span.width > 0) {
+						int first = std::max(0, span.left >> TILE_SHIFT);
+						int last = std::min(tileCount - 1, (span.left + span.width - 1) >> TILE_SHIFT);
+						for (int t = first; t <= last; t++) buffer.dirty[t] = 1;
 					}
 				}
+			};
+			markMoved(buffer.objects, frame.objects);
+			markMoved(frame.objects, buffer.objects);
+		}
+
+		buffer.dirtyTiles.clear();
+		for (int t = 0; t < tileCount; t++) {
+			if (buffer.dirty[t]) buffer.dirtyTiles.push_back(t);
+		}
+
+		buffer.bValid = true;
+		buffer.player = frame.player;
+		buffer.objects = frame.objects;
+		buffer.lights = frame.lights;
+		buffer.mapVersion = mapVersion;
+		buffer.backend = rayBackend;
+		buffer.bWallSpans = useWallSpans();
+		buffer.resolution = renderSize;
+		buffer.bReconstructed = interleaveParity >= 0;
+	}
+
+	// Interleaving needs a previous frame of the same map and resolution, and a
+	// camera that moved (a resting one gets an exact frame) but not too far.
+	int chooseInterleaveParity(const FrameState& frame) {
+		previousFrame = &backBuffers[(backBuffer + BACK_BUFFERS - 1) % BACK_BUFFERS];
+		const BackBuffer& previous = *previousFrame;
+		if (!bInterleaved || useWallSpans() || !previous.bValid || previous.mapVersion != mapVersion || previous.backend != rayBackend || previous.resolution != renderSize) {
+			return -1;
+		}
+		float turn = std::abs(frame.player.angle - previous.player.angle) / FOV * renderSize.x;
+		float move = (olc::vf2d(frame.player.x, frame.player.y) - olc::vf2d(previous.player.x, previous.player.y)).mag();
+		if (turn > INTERLEAVE_MAX_TURN || move > INTERLEAVE_MAX_MOVE || (turn == 0 && move == 0)) {
+			return -1;
+		}
+		return interleaveFrame++ & 1;
+	}
+
+	// Sweeps every fireball's movement this step in one batch, so none can pass
+	// through a wall however long the step. Hits stop on the wall and flash there.
+	void moveFireballs(float fElapsedTime) {
+		std::vector<Fireball*> fireballs;
+		sweepFrom.clear();
+		sweepTo.clear();
+		for (GameObject* obj : gameObjects) {
+			Fireball* fireball = dynamic_cast<Fireball*>(obj);
+			if (!fireball || fireball->bRemoved) continue;
+			fireballs.push_back(fireball);
+			sweepFrom.push_back(fireball->pos);
+			sweepTo.push_back(fireball->pos + fireball->v * fElapsedTime);
+		}
+		if (world) {
+			sweepAll(*world, sweepFrom, sweepTo, sweepHits);
+		}
+		else {
+			sweepAll(gameMap, sweepFrom, sweepTo, sweepHits);
+		}
+
+		for (size_t i = 0; i < fireballs.size(); i++) {
+			Fireball* fireball = fireballs[i];
+			const SweepHit& hit = sweepHits[i];
+			fireball->pos = hit.point;
+			if (hit.bHit) {
+				fireball->bRemoved = true;
+				gameObjects.push_back(new ImpactFlash(fireballTexture, hit.point + hit.normal * 0.1f));
+			}
+			else if (hit.point.x < 0 || hit.point.x >= gameSize.x || hit.point.y < 0 || hit.point.y >= gameSize.y) {
+				fireball->bRemoved = true;
 			}
 		}
 	}
 
+	// Knocks out the wall the player faces within WALL_REACH, or else builds one
+	// in the empty cell just ahead. With bWide it's the 3x3 block around that
+	// cell instead. Only queued, the map changes at the sync point.
+	void toggleWallAhead(FrameState& out, bool bWide) const {
+		olc::vf2d pos(player.x, player.y), forward(cosf(player.angle), sinf(player.angle));
+		int extent = bWide ? 1 : 0;
+		RaycastResult hit = cast_ray(pos, forward, gameMap, WALL_REACH);
+		if (hit.bHit && hit.distance <= WALL_REACH) {
+			out.mapEdits.push_back({ { hit.cell - olc::vi2d(extent, extent), hit.cell + olc::vi2d(extent + 1, extent + 1) }, 0 });
+			return;
+		}
+
+		olc::vi2d cell = pos + forward;
+		if (cell.x < 0 || cell.y < 0 || cell.x >= gameSize.x || cell.y >= gameSize.y) return;
+		MapRect rect = { cell - olc::vi2d(extent, extent), cell + olc::vi2d(extent + 1, extent + 1) };
+		float nx = std::max(float(rect.min.x), std::min(float(rect.max.x), pos.x)), ny = std::max(float(rect.min.y), std::min(float(rect.max.y), pos.y));
+		if ((olc::vf2d(nx, ny) - pos).mag() <= PLAYER_RADIUS) return;
+		out.mapEdits.push_back({ rect, 1 });
+	}
+
+	// Runs on simThread: advances the player and the objects by one step and
+	// snapshots the result into `out` for the next frame's render.
+	void simulate(const FrameInput& input, float fElapsedTime, FrameState& out) {
+		out.mapEdits.clear();
+
+		if (input.bTurnLeft) {
+			player.angle -= 0.5 * fElapsedTime;
+		}
+
+		if (input.bTurnRight) {
+			player.angle += 0.5 * fElapsedTime;
+		}
+
+		olc::vf2d forward(cosf(player.angle), sinf(player.angle));
+		olc::vf2d move(0, 0);
+		if (input.bForward) {
+			move += forward * fElapsedTime;
+		}
+
+		if (input.bBack) {
+			move -= forward * fElapsedTime;
+		}
+
+		if (input.bStrafeLeft) {
+			move += olc::vf2d(forward.y, -forward.x) * fElapsedTime;
+		}
+
+		if (input.bStrafeRight) {
+			move -= olc::vf2d(forward.y, -forward.x) * fElapsedTime;
+		}
+
+		olc::vf2d pos(player.x, player.y);
+		pos = world ? CircleCollision::move(*world, pos, move, PLAYER_RADIUS) : CircleCollision::move(gameMap, pos, move, PLAYER_RADIUS);
+		player.x = pos.x;
+		player.y = pos.y;
+
+		// Streamed worlds are read-only
+		if (input.bToggleWall && !world) {
+			toggleWallAhead(out, input.bWideEdit);
+		}
+
+		if (input.bFire) {
+			float noise = (rand() / (float)RAND_MAX - 0.5f) / 6;
+			Fireball* fireball = new Fireball(fireballTexture, player.x, player.y, cosf(player.angle+noise)*2, sinf(player.angle+noise)*2);
+			//fireball->pos.x += fireball->v.x * 0.1f + (rand() / (float)RAND_MAX - 0.5f) / 4;
+			//fireball->pos.y += fireball->v.y * 0.1f + (rand() / (float)RAND_MAX - 0.5f) / 4;
+			gameObjects.push_back(fireball);
+		}
+
+		for (GameObject* obj : gameObjects) {
+			obj->update(fElapsedTime);
+		}
+		// After the updates, so flashes from this step's hits aren't aged by it yet
+		moveFireballs(fElapsedTime);
+
+		for (int i = gameObjects.size() - 1; i >= 0; i--) {
+			if (gameObjects[i]->bRemoved) {
+				delete gameObjects[i];
+				gameObjects.erase(gameObjects.begin() + i);
+			}
+		}
+
+		snapshot(out);
+	}
+
+	// Starts rendering frames[renderFrame] into backBuffers[backBuffer] on renderPool,
+	// and simulating the frame after it into the other FrameState on simThread.
+	void startFrame(const FrameInput& input, float fElapsedTime) {
+		const FrameState& frame = frames[renderFrame];
+		FrameState& next = frames[1 - renderFrame];
+		simulation = simThread->submit([this, input, fElapsedTime, &next] { simulate(input, fElapsedTime, next); });
+
+		// drawWall writes every pixel of its column, so there's no Clear()
+		renderSize = bDynamicResolution ? scaler.resolution() : olc::vi2d(ScreenWidth(), ScreenHeight());
+		renderTarget = &backBuffers[backBuffer];
+		frameLights = &frame.lightGrid;
+		interleaveParity = chooseInterleaveParity(frame);
+		markDirtyTiles(*renderTarget, frame);
+
+		renderStart = std::chrono::steady_clock::now();
+		renderEnd = raycastTime = objectsTime = 0;
+		renderJob = renderPool->parallelForAsync((int)renderTarget->dirtyTiles.size(), 1, [this, &frame](int begin, int end) {
+			using namespace std::chrono;
+			for (int i = begin; i < end; i++) {
+				int x0 = renderTarget->dirtyTiles[i] * TILE_WIDTH;
+				int x1 = std::min(renderSize.x, x0 + TILE_WIDTH);
+				auto t0 = steady_clock::now();
+				raycast(frame.player, x0, x1);
+				auto t1 = steady_clock::now();
+				drawObjects(frame, x0, x1);
+				auto t2 = steady_clock::now();
+				raycastTime += duration_cast<nanoseconds>(t1 - t0).count();
+				objectsTime += duration_cast<nanoseconds>(t2 - t1).count();
+			}
+			int64_t finished = duration_cast<nanoseconds>(steady_clock::now() - renderStart).count();
+			int64_t latest = renderEnd;
+			while (finished > latest && !renderEnd.compare_exchange_weak(latest, finished)) {}
+		});
+	}
+
+	void finishFrame() {
+		WorkerPool::wait(renderJob);
+		if (simulation.valid()) simulation.get();
+	}
+
+	// Only frames that were rendered completely say what a frame at this resolution costs
+	void updateResolution(const BackBuffer& rendered) {
+		if (!bDynamicResolution || (int)rendered.dirtyTiles.size() < (rendered.resolution.x + TILE_WIDTH - 1) >> TILE_SHIFT) {
+			return;
+		}
+		scaler.addSample(renderEnd / 1e6f, raycastTime / 1e6f, objectsTime / 1e6f);
+	}
+
+	void snapshot(FrameState& out) {
+		out.player = player;
+		out.objects.clear();
+		out.lights.clear();
+		for (GameObject* obj : gameObjects) {
+			out.objects.push_back({ obj->sprite, obj->pos, obj->scale });
+			PointLight light;
+			if (obj->getLight(light)) out.lights.push_back(light);
+		}
+
+		// Walls further than MAX_DISTANCE aren't drawn, so neither are lights on them
+		int reach = int(std::ceil(MAX_DISTANCE)) + 1;
+		MapRect window = { olc::vi2d(std::max(0, int(player.x) - reach), std::max(0, int(player.y) - reach)),
+			olc::vi2d(std::min(gameSize.x, int(player.x) + reach + 1), std::min(gameSize.y, int(player.y) + reach + 1)) };
+		out.shadows.clear();
+		if (bShadows) {
+			for (const PointLight& light : out.lights) {
+				bool bNear = light.pos.x + light.radius > window.min.x && light.pos.x - light.radius < window.max.x
+					&& light.pos.y + light.radius > window.min.y && light.pos.y - light.radius < window.max.y;
+				out.shadows.push_back(!bNear ? nullptr : world ? shadowCache.get(*world, light.pos, light.radius) : shadowCache.get(gameMap, light.pos, light.radius));
+			}
+		}
+		out.lightGrid.build(out.lights, window, out.shadows);
+	}
+
 public:
-	Game()
+	Game(const std::string& worldFile = "") : worldFile(worldFile)
 	{
 		// Name your application
 		sAppName = "Example";
 	}
 
+	~Game()
+	{
+		delete renderPool;
+		delete simThread;
+		delete textures;
+		delete loadPool;
+		delete world;
+		delete minimap;
+	}
+
+	bool exportWorld(const std::string& path)
+	{
+		MemoryChunkSource source(gameMap.rows());
+		return writeChunkFile(path, source);
+	}
+
+	// Offline step: decodes the images into the texture cache, so runs after this only map them
+	bool cacheTextures(const std::vector<std::string>& paths)
+	{
+		bool bOk = true;
+		for (const std::string& path : paths) {
+			olc::Sprite sprite;
+			std::shared_ptr<const MappedTexture> mapped;
+			if (!textureCache.load(path, sprite, mapped) || !mapped) {
+				std::cout << "Could not cache texture " << path << '\n';
+				bOk = false;
+			}
+		}
+		return bOk;
+	}
+
+	// Offline step for a static chunk world, writes worldPath + ".pvs"
+	bool exportVisibility(const std::string& worldPath)
+	{
+		FileChunkSource source(worldPath);
+		if (!source.isOpen()) {
+			std::cout << "Could not open world " << worldPath << '\n';
+			return false;
+		}
+		GameMap map(readAllCells(source));
+		WorkerPool pool;
+		PotentiallyVisibleSet visibility;
+		visibility.build(map, MAX_DISTANCE, &pool);
+		return visibility.save(worldPath + ".pvs");
+	}
+
+	// Offline step for a static chunk world, writes worldPath + ".lightmap"
+	bool exportLighting(const std::string& worldPath)
+	{
+		FileChunkSource source(worldPath);
+		if (!source.isOpen()) {
+			std::cout << "Could not open world " << worldPath << '\n';
+			return false;
+		}
+		GameMap map(readAllCells(source));
+		WorkerPool pool;
+		Lightmap baked;
+		baked.setLights(lampLights(), AMBIENT_LIGHT);
+		baked.bake(map, &pool);
+		return baked.save(worldPath + ".lightmap");
+	}
+
 public:
 	Player player = { 2,2,0 };
 
@@ -404,82 +1128,317 @@ public:
 	{
 		//raycast();
 		// Called once at the start, so create things here
-		wallTexture = new olc::Sprite("wall_texture_adj.JPG");
-		fireballTexture = new olc::Sprite("fireball.png");
-		lampTexture = new olc::Sprite("lamp_sprite.png");
+		if (!worldFile.empty()) {
+			FileChunkSource* source = new FileChunkSource(worldFile);
+			if (!source->isOpen()) {
+				std::cout << "Could not open world " << worldFile << '\n';
+				delete source;
+				return false;
+			}
+			world = new ChunkedMap(std::unique_ptr<ChunkSource>(source));
+			W = world->size().x;
+			H = world->size().y;
+			gameSize = olc::vi2d(W, H);
+			world->update({ player.x, player.y });
+			world->waitIdle();
+			if (!pvs.load(worldFile + ".pvs", world->size(), MAX_DISTANCE)) {
+				std::cout << "No visibility data for " << worldFile << ", objects are not culled (see --pvs)\n";
+			}
+		}
+		else {
+			pvs.build(gameMap, MAX_DISTANCE);
+		}
+
+		loadPool = new WorkerPool();
+		textures = new TextureLoader(*loadPool, &textureCache);
+		colorMap = ColorMap(FOG_COLOR, FOG_START, MAX_DISTANCE);
+		for (const char* file : WALL_TEXTURE_FILES) {
+			wallTextures.push_back(textures->load(file, olc::GREY, false).sprite);
+		}
+		buildWallArray();
+		fireballTexture = textures->load("fireball.png", olc::BLANK).sprite;
+		lampTexture = textures->load("lamp_sprite.png", olc::BLANK).sprite;
 
-		gameObjects.push_back(new GameObject(lampTexture, 3, 3));
-		gameObjects.push_back(new GameObject(lampTexture, 4, 4));
+		for (const olc::vf2d& pos : LAMP_POSITIONS) {
+			gameObjects.push_back(new GameObject(lampTexture, pos.x, pos.y));
+		}
+		loadLighting();
 		depthBuffer = new float[ScreenWidth()*ScreenHeight()];
 
+		minimap = new Minimap(olc::vi2d(MINIMAP_SIZE, MINIMAP_SIZE));
+		minimapDecal = new olc::Decal(minimap->getSprite());
+		wallSegments.build(gameMap);
+		gameMap.addChangeListener([this](const MapRect& rect) {
+			minimap->invalidate(rect);
+			wallSegments.update(gameMap, rect);
+			pvs.clear();
+			if (!world) lightmap.update(gameMap, rect);
+			shadowCache.invalidate(rect);
+			mapVersion++;
+		});
+
+		renderPool = new WorkerPool();
+		simThread = new WorkerPool(1);
+		scaler = ResolutionScaler(olc::vi2d(ScreenWidth(), ScreenHeight()));
+		snapshot(frames[renderFrame]);
+
+		for (BackBuffer& buffer : backBuffers) {
+			for (int x = 0; x < ScreenWidth(); x += TILE_WIDTH) {
+				buffer.tiles.push_back(new olc::Sprite(std::min(TILE_WIDTH, ScreenWidth() - x), ScreenHeight()));
+				buffer.tileDecals.push_back(new olc::Decal(buffer.tiles.back()));
+			}
+			buffer.columnHits.resize(ScreenWidth());
+		}
+		// Nothing is drawn to layer 0 itself anymore, the back buffers are drawn over it as decals
+		EnablePixelTransfer(false);
+
+		startFrame(FrameInput{}, 0.0f);
+
+		return true;
+	}
+
+	bool OnUserDestroy() override
+	{
+		finishFrame();
+		for (BackBuffer& buffer : backBuffers) {
+			for (olc::Decal* decal : buffer.tileDecals) delete decal;
+			for (olc::Sprite* tile : buffer.tiles) delete tile;
+		}
+		delete minimapDecal;
 		return true;
 	}
 
 	bool OnUserUpdate(float fElapsedTime) override
 	{
+		FrameInput input = {
+			GetKey(olc::W).bHeld, GetKey(olc::S).bHeld,
+			GetKey(olc::A).bHeld, GetKey(olc::D).bHeld,
+			GetKey(olc::Q).bHeld, GetKey(olc::E).bHeld,
+			GetKey(olc::SPACE).bPressed,
+			GetKey(olc::T).bPressed, GetKey(olc::SHIFT).bHeld
+		};
+
+		// Frame N was rendered into backBuffers[backBuffer] while N+1 was simulated,
+		// both started by the previous call
+		finishFrame();
+		BackBuffer& presented = backBuffers[backBuffer];
+		updateResolution(presented);
+
+		// Nothing else is running here, so this is where the world changes
+		FrameState& next = frames[1 - renderFrame];
+		gameMap.batch([&](GameMap& map) {
+			for (const FrameState::MapEdit& edit : next.mapEdits) {
+				map.fillRect(edit.rect.min.x, edit.rect.min.y, edit.rect.max.x - edit.rect.min.x, edit.rect.max.y - edit.rect.min.y, edit.value);
+			}
+		});
 
-		if (GetKey(olc::W).bHeld) {
-			player.x += cosf(player.angle) * fElapsedTime;
-			player.y += sinf(player.angle) * fElapsedTime;
+		// Textures that finished decoding replace their placeholders, everything drawn with those is stale
+		if (textures->poll() > 0) {
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
+			buildWallArray();
+		}
+		if (swapInPalettizedWalls()) {
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
 		}
 
-		if (GetKey(olc::A).bHeld) {
-			player.angle -= 0.5 * fElapsedTime;
+		// Render workers and simThread read world between startFrame() and finishFrame(), never during this
+		if (world) {
+			world->update({ next.player.x, next.player.y });
+			if (world->getGeneration() != worldGeneration) {
+				worldGeneration = world->getGeneration();
+				minimap->invalidateAll();
+				shadowCache.clear();
+				mapVersion++;
+			}
 		}
 
-		if (GetKey(olc::D).bHeld) {
-			player.angle += 0.5 * fElapsedTime;
+		if (GetKey(olc::R).bPressed) {
+			rayBackend = RayBackend(((int)rayBackend + 1) % 3);
+			std::cout << "Ray backend: " << rayBackendName(rayBackend) << '\n';
 		}
 
-		if (GetKey(olc::S).bHeld) {
-			player.x -= cosf(player.angle) * fElapsedTime;
-			player.y -= sinf(player.angle) * fElapsedTime;
+		if (GetKey(olc::B).bPressed) {
+			bWallSpans = !bWallSpans;
+			std::cout << "Walls from " << (bWallSpans ? "segment spans" : "rays") << '\n';
 		}
 
-		if (GetKey(olc::Q).bHeld) {
-			player.y -= cosf(player.angle) * fElapsedTime;
-			player.x += sinf(player.angle) * fElapsedTime;
+		if (GetKey(olc::P).bPressed) {
+			bPalettizedWalls = !bPalettizedWalls;
+			buildWallArray();
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
+			std::cout << "Wall textures " << (bPalettizedWalls ? "palettized" : "true colour") << '\n';
 		}
 
-		if (GetKey(olc::E).bHeld) {
-			player.y += cosf(player.angle) * fElapsedTime;
-			player.x -= sinf(player.angle) * fElapsedTime;
+		if (GetKey(olc::G).bPressed) {
+			bFog = !bFog;
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
+			std::cout << "Fog " << (bFog ? "on" : "off") << '\n';
 		}
 
-		if (GetKey(olc::SPACE).bPressed) {
-			float noise = (rand() / (float)RAND_MAX - 0.5f) / 6;
-			Fireball* fireball = new Fireball(fireballTexture, player.x, player.y, cosf(player.angle+noise)*2, sinf(player.angle+noise)*2, gameMap, gameSize);
-			//fireball->pos.x += fireball->v.x * 0.1f + (rand() / (float)RAND_MAX - 0.5f) / 4;
-			//fireball->pos.y += fireball->v.y * 0.1f + (rand() / (float)RAND_MAX - 0.5f) / 4;
-			gameObjects.push_back(fireball);
+		if (GetKey(olc::L).bPressed) {
+			bLighting = !bLighting;
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
+			std::cout << "Lighting " << (bLighting ? "on" : "off") << '\n';
 		}
 
-		for (int i = gameObjects.size() - 1; i >= 0; i--) {
-			gameObjects[i]->update(fElapsedTime);
-			if (gameObjects[i]->bRemoved) {
-				delete gameObjects[i];
-				gameObjects.erase(gameObjects.begin() + i);
-			}
+		if (GetKey(olc::H).bPressed) {
+			bShadows = !bShadows;
+			for (BackBuffer& buffer : backBuffers) buffer.bValid = false;
+			std::cout << "Shadows of moving lights " << (bShadows ? "on" : "off") << '\n';
 		}
 
-		fill(depthBuffer, depthBuffer + ScreenWidth()*ScreenHeight(), 1000.0f);
+		if (GetKey(olc::I).bPressed) {
+			bInterleaved = !bInterleaved;
+			std::cout << "Interleaved columns " << (bInterleaved ? "on" : "off") << '\n';
+		}
 
-		Clear(olc::BLACK);
-		raycast();
-		drawObjects();
-		drawMap();
+		if (GetKey(olc::V).bPressed) {
+			bAdaptive = !bAdaptive;
+			std::cout << "Adaptive columns " << (bAdaptive ? "on" : "off") << '\n';
+		}
 
-	
+		if (GetKey(olc::F).bPressed) {
+			bDynamicResolution = !bDynamicResolution;
+			scaler.reset();
+			std::cout << "Dynamic resolution " << (bDynamicResolution ? "on" : "off") << '\n';
+		}
+
+		if (GetKey(olc::PGUP).bPressed) {
+			minimap->zoomIn();
+		}
+
+		if (GetKey(olc::PGDN).bPressed) {
+			minimap->zoomOut();
+		}
+
+		renderFrame = 1 - renderFrame;
+		backBuffer = (backBuffer + 1) % BACK_BUFFERS;
+		startFrame(input, fElapsedTime);
+
+		// Frame N is uploaded while N+1 renders into the other back buffer.
+		// Tiles it didn't redraw still hold the right texture from before.
+		for (int t : presented.dirtyTiles) {
+			presented.tileDecals[t]->Update();
+		}
+		olc::vf2d upscale(ScreenWidth() / (float)presented.resolution.x, ScreenHeight() / (float)presented.resolution.y);
+		for (int x = 0, t = 0; x < presented.resolution.x; x += TILE_WIDTH, t++) {
+			olc::vf2d source(float(std::min(TILE_WIDTH, presented.resolution.x - x)), float(presented.resolution.y));
+			DrawPartialDecal(olc::vf2d(x * upscale.x, 0), source * upscale, presented.tileDecals[t], olc::vf2d(0, 0), source);
+		}
+		drawMap(presented);
 		return true;
 	}
 };
 
-int main()
+// Times every ray backend on the same fans of rays (one 600-column view per
+// sample position, like drawWall issues) and checks they agree on what was hit.
+void benchmarkRayBackends(const GameMap& map, float maxDistance)
+{
+	std::mt19937 rng(1234);
+	std::vector<std::pair<olc::vf2d, olc::vf2d>> rays;
+	while (rays.size() < 600 * 200) {
+		olc::vf2d start(rng() % map.size().x + 0.5f, rng() % map.size().y + 0.5f);
+		if (map.isSolid((int)start.x, (int)start.y)) continue;
+		float angle = (rng() % 6283) / 1000.0f;
+		for (int x = 0; x < 600; x++) {
+			float a = angle + x / 600.0f * PI / 4;
+			rays.push_back({ start, olc::vf2d(cosf(a), sinf(a)) });
+		}
+	}
+
+	std::vector<RaycastResult> reference;
+	for (RayBackend backend : { RayBackend::DDA, RayBackend::Hierarchical, RayBackend::DistanceField }) {
+		std::vector<RaycastResult> results;
+		results.reserve(rays.size());
+		auto t0 = std::chrono::steady_clock::now();
+		for (auto& ray : rays) {
+			results.push_back(cast_ray(backend, ray.first, ray.second, map, maxDistance));
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - t0;
+
+		int mismatches = 0;
+		if (reference.empty()) {
+			reference = results;
+		}
+		for (size_t i = 0; i < results.size(); i++) {
+			if (results[i].bHit != reference[i].bHit || (results[i].bHit && results[i].cell != reference[i].cell)) mismatches++;
+		}
+		std::cout << rayBackendName(backend) << ": " << elapsed.count() << " ms for " << rays.size() << " rays, " << mismatches << " disagree with DDA\n";
+	}
+}
+
+// Sparse outdoor-style test map: a border wall and scattered small buildings.
+std::vector<std::vector<int>> makeSparseMap(int size, int buildings)
+{
+	std::mt19937 rng(42);
+	std::vector<std::vector<int>> rows(size, std::vector<int>(size, 0));
+	for (int i = 0; i < size; i++) {
+		rows[0][i] = rows[size - 1][i] = rows[i][0] = rows[i][size - 1] = 1;
+	}
+	for (int b = 0; b < buildings; b++) {
+		int x0 = 1 + rng() % (size - 14), y0 = 1 + rng() % (size - 14);
+		int w = 2 + rng() % 12, h = 2 + rng() % 12;
+		for (int y = y0; y < y0 + h; y++) {
+			for (int x = x0; x < x0 + w; x++) {
+				rows[y][x] = 1;
+			}
+		}
+	}
+	return rows;
+}
+
+// Usage: Raycasting [world.chunks]
+//        Raycasting --export world.chunks   (writes the built-in level as a chunk file)
+//        Raycasting --bench [world.chunks]  (ray backend timings on that world or a generated sparse one)
+//        Raycasting --pvs world.chunks      (precomputes object culling visibility into world.chunks.pvs)
+//        Raycasting --lightmap world.chunks (bakes the lamps' light on that world's walls into world.chunks.lightmap)
+//        Raycasting --cache-textures [images...]  (pre-decodes the game's or the given images into texture_cache/)
+int main(int argc, char** argv)
 {
 	//Game demo;
 	//if (demo.Construct(800, 600, 2, 2))
 	//	demo.Start();
-	Game window;
+	if (argc > 2 && std::string(argv[1]) == "--export") {
+		Game exporter;
+		return exporter.exportWorld(argv[2]) ? 0 : 1;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--cache-textures") {
+		Game baker;
+		std::vector<std::string> paths(argv + 2, argv + argc);
+		if (paths.empty()) paths = { "wall_texture_adj.JPG", "fireball.png", "lamp_sprite.png" };
+		return baker.cacheTextures(paths) ? 0 : 1;
+	}
+
+	if (argc > 2 && std::string(argv[1]) == "--pvs") {
+		Game exporter;
+		return exporter.exportVisibility(argv[2]) ? 0 : 1;
+	}
+
+	if (argc > 2 && std::string(argv[1]) == "--lightmap") {
+		Game baker;
+		return baker.exportLighting(argv[2]) ? 0 : 1;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--bench") {
+		std::vector<std::vector<int>> rows;
+		if (argc > 2) {
+			FileChunkSource source(argv[2]);
+			rows = readAllCells(source);
+		}
+		else {
+			rows = makeSparseMap(4096, 4000);
+		}
+		GameMap map(rows);
+		for (DistanceField::Metric metric : { DistanceField::Metric::Chebyshev, DistanceField::Metric::Euclidean }) {
+			map.setDistanceMetric(metric);
+			std::cout << (metric == DistanceField::Metric::Chebyshev ? "-- Chebyshev field --\n" : "-- Euclidean field --\n");
+			benchmarkRayBackends(map, 256.0f);
+		}
+		return 0;
+	}
+
+	Game window(argc > 1 ? argv[1] : "");
 	if (window.Construct(600, 600, 1, 1)) {
 		window.Start();
 	}
@@ -0,0 +1,61 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "Raycast.h"
+#include <vector>
+#include <cmath>
+
+// Where a movement first touches a wall
+struct SweepHit {
+	bool bHit = false;
+	float t = 1.0f;       // Fraction of the movement done before the hit, 1 without one
+	olc::vf2d point;      // Where it stops: on the wall, or at the end of the movement
+	olc::vf2d normal;     // Of the wall face that was hit, pointing out of the wall
+	olc::vi2d cell;       // Wall cell that was hit
+};
+
+// Moves a point from `from` to `to` through the map with a cast_ray along the
+// segment, so walls are found however far it moves in one step, thin ones
+// included. A point that starts inside a wall hits it right away.
+template <typename Map>
+SweepHit sweep(const Map& map, const olc::vf2d& from, const olc::vf2d& to) {
+	SweepHit result;
+	result.point = to;
+	olc::vf2d move = to - from;
+	float length = move.mag();
+	olc::vi2d start(int(std::floor(from.x)), int(std::floor(from.y)));
+	olc::vi2d size = map.size();
+
+	if (start.x >= 0 && start.y >= 0 && start.x < size.x && start.y < size.y && map.isSolid(start.x, start.y)) {
+		result.bHit = true;
+		result.t = 0.0f;
+		result.point = from;
+		result.cell = start;
+		result.normal = std::abs(move.x) > std::abs(move.y) ? olc::vf2d(move.x > 0 ? -1.0f : 1.0f, 0.0f) : olc::vf2d(0.0f, move.y > 0 ? -1.0f : 1.0f);
+		return result;
+	}
+	if (length <= 0) return result;
+
+	olc::vf2d dir = move / length;
+	RaycastResult hit = cast_ray(from, dir, map, length);
+	if (!hit.bHit || hit.distance > length) return result;
+
+	// The ray came in through the face that the hit point lies on
+	olc::vf2d point = from + dir * hit.distance;
+	float faceX = float(dir.x > 0 ? hit.cell.x : hit.cell.x + 1), faceY = float(dir.y > 0 ? hit.cell.y : hit.cell.y + 1);
+	bool bXFace = dir.y == 0 || (dir.x != 0 && std::abs(point.x - faceX) <= std::abs(point.y - faceY));
+	result.bHit = true;
+	result.t = hit.distance / length;
+	result.point = point;
+	result.normal = bXFace ? olc::vf2d(dir.x > 0 ? -1.0f : 1.0f, 0.0f) : olc::vf2d(0.0f, dir.y > 0 ? -1.0f : 1.0f);
+	result.cell = hit.cell;
+	return result;
+}
+
+// Sweeps every from[i] -> to[i] in one pass, hits[i] gets the result
+template <typename Map>
+void sweepAll(const Map& map, const std::vector<olc::vf2d>& from, const std::vector<olc::vf2d>& to, std::vector<SweepHit>& hits) {
+	hits.resize(from.size());
+	for (size_t i = 0; i < from.size(); i++) {
+		hits[i] = sweep(map, from[i], to[i]);
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "TextureCache.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+// Same-size textures in one block of memory, laid out like the texture cache:
+// per mip level every layer's texels one after the other, column-major. A texel
+// is found from (layer, level, x) with index arithmetic only, so drawing
+// columns of different wall types never follows a Sprite pointer.
+//
+// palettize() replaces the 32-bit texels with 8-bit indices into a palette per
+// layer, a quarter of the memory and of the bytes read per texel.
+class TextureArray {
+	olc::vi2d layerSize = { 1, 1 };
+	int layerCount = 0;
+	std::vector<olc::vi2d> levelSizes;
+	std::vector<size_t> levelOffsets;
+	std::vector<olc::Pixel> texels;
+	std::vector<uint8_t> indices;      // Same layout as texels, when palettized
+	std::vector<olc::Pixel> palettes;  // PALETTE_SIZE per layer
+
+	size_t offset(int layer, int level, int x) const {
+		return levelOffsets[level] + (size_t(layer) * levelSizes[level].x + x) * levelSizes[level].y;
+	}
+
+	// Median cut: splits the box with the widest channel range at its median until
+	// there are PALETTE_SIZE boxes, each box's average is a palette entry
+	static std::vector<olc::Pixel> medianCut(std::vector<olc::Pixel> colors) {
+		struct Box { size_t begin, end; };
+		auto widest = [&](const Box& box, int& channel) {
+			int lo[4] = { 255, 255, 255, 255 }, hi[4] = {};
+			for (size_t i = box.begin; i < box.end; i++) {
+				const uint8_t c[4] = { colors[i].r, colors[i].g, colors[i].b, colors[i].a };
+				for (int k = 0; k < 4; k++) {
+					lo[k] = std::min(lo[k], (int)c[k]);
+					hi[k] = std::max(hi[k], (int)c[k]);
+				}
+			}
+			channel = 0;
+			for (int k = 1; k < 4; k++) {
+				if (hi[k] - lo[k] > hi[channel] - lo[channel]) channel = k;
+			}
+			return hi[channel] - lo[channel];
+		};
+
+		std::vector<Box> boxes = { { 0, colors.size() } };
+		while (boxes.size() < PALETTE_SIZE) {
+			int best = -1, bestChannel = 0, bestRange = 0;
+			for (int i = 0; i < (int)boxes.size(); i++) {
+				int channel, range = widest(boxes[i], channel);
+				if (range > bestRange && boxes[i].end - boxes[i].begin > 1) {
+					best = i;
+					bestChannel = channel;
+					bestRange = range;
+				}
+			}
+			if (best < 0) break;
+
+			Box box = boxes[best];
+			size_t middle = box.begin + (box.end - box.begin) / 2;
+			std::nth_element(colors.begin() + box.begin, colors.begin() + middle, colors.begin() + box.end, [&](const olc::Pixel& a, const olc::Pixel& b) {
+				const uint8_t ca[4] = { a.r, a.g, a.b, a.a }, cb[4] = { b.r, b.g, b.b, b.a };
+				return ca[bestChannel] < cb[bestChannel];
+			});
+			boxes[best] = { box.begin, middle };
+			boxes.push_back({ middle, box.end });
+		}
+
+		std::vector<olc::Pixel> palette;
+		for (const Box& box : boxes) {
+			uint64_t sum[4] = {};
+			for (size_t i = box.begin; i < box.end; i++) {
+				sum[0] += colors[i].r; sum[1] += colors[i].g; sum[2] += colors[i].b; sum[3] += colors[i].a;
+			}
+			size_t n = std::max<size_t>(1, box.end - box.begin);
+			palette.push_back(olc::Pixel(uint8_t(sum[0] / n), uint8_t(sum[1] / n), uint8_t(sum[2] / n), uint8_t(sum[3] / n)));
+		}
+		palette.resize(PALETTE_SIZE, palette.back());
+		return palette;
+	}
+
+public:
+	static constexpr int PALETTE_SIZE = 256;
+
+	bool isEmpty() const { return layerCount == 0; }
+	bool isPalettized() const { return !indices.empty(); }
+	int layers() const { return layerCount; }
+	int levels() const { return (int)levelSizes.size(); }
+	olc::vi2d size(int level = 0) const { return levelSizes[level]; }
+
+	// Layer i is mapped[i], or sprites[i] where that's null, scaled (nearest) to
+	// the largest size among them. A cache entry of that size has its mip chain
+	// copied as it is, otherwise the chain is filtered here; sprites[i] is only
+	// read in that case. mapped may be shorter or hold nulls.
+	void build(const std::vector<const olc::Sprite*>& sprites, const std::vector<std::shared_ptr<const MappedTexture>>& mapped) {
+		layerCount = (int)sprites.size();
+		layerSize = { 1, 1 };
+		for (int layer = 0; layer < layerCount; layer++) {
+			const MappedTexture* source = layer < (int)mapped.size() ? mapped[layer].get() : nullptr;
+			olc::vi2d size = source ? source->size() : olc::vi2d(sprites[layer]->width, sprites[layer]->height);
+			layerSize = { std::max(layerSize.x, size.x), std::max(layerSize.y, size.y) };
+		}
+
+		levelSizes.assign(1, layerSize);
+		while (levelSizes.back().x > 1 || levelSizes.back().y > 1) {
+			levelSizes.push_back({ std::max(1, levelSizes.back().x / 2), std::max(1, levelSizes.back().y / 2) });
+		}
+		levelOffsets.clear();
+		size_t total = 0;
+		for (const olc::vi2d& s : levelSizes) {
+			levelOffsets.push_back(total);
+			total += size_t(s.x) * s.y * layerCount;
+		}
+		texels.assign(total, olc::Pixel());
+		indices.clear();
+		palettes.clear();
+
+		for (int layer = 0; layer < layerCount; layer++) {
+			const MappedTexture* source = layer < (int)mapped.size() ? mapped[layer].get() : nullptr;
+			if (source && source->size() == layerSize && source->levels() == levels()) {
+				for (int level = 0; level < levels(); level++) {
+					std::memcpy(column(layer, level, 0), source->column(level, 0), size_t(levelSizes[level].x) * levelSizes[level].y * sizeof(olc::Pixel));
+				}
+				continue;
+			}
+
+			// A mapped texture of another size is scaled from its level 0
+			const olc::Sprite* sprite = sprites[layer];
+			olc::vi2d size = source ? source->size() : olc::vi2d(sprite->width, sprite->height);
+			for (int x = 0; x < layerSize.x; x++) {
+				olc::Pixel* out = column(layer, 0, x);
+				int sx = x * size.x / layerSize.x;
+				for (int y = 0; y < layerSize.y; y++) {
+					int sy = y * size.y / layerSize.y;
+					out[y] = source ? source->column(0, sx)[sy] : sprite->pColData[size_t(sy) * sprite->width + sx];
+				}
+			}
+			for (int level = 1; level < levels(); level++) {
+				olc::vi2d size;
+				std::vector<olc::Pixel> next = halveColumns(column(layer, level - 1, 0), levelSizes[level - 1], size);
+				std::copy(next.begin(), next.end(), column(layer, level, 0));
+			}
+		}
+	}
+
+	// Converts every layer to 8-bit indices into its own palette and frees the 32-bit texels
+	void palettize() {
+		if (isEmpty() || isPalettized()) return;
+		indices.resize(texels.size());
+		palettes.resize(size_t(layerCount) * PALETTE_SIZE);
+
+		for (int layer = 0; layer < layerCount; layer++) {
+			// Quantized from at most 64K evenly spread texels
+			const olc::Pixel* base = column(layer, 0, 0);
+			size_t count = size_t(layerSize.x) * layerSize.y, stride = std::max<size_t>(1, count / 65536);
+			std::vector<olc::Pixel> samples;
+			for (size_t i = 0; i < count; i += stride) samples.push_back(base[i]);
+			std::vector<olc::Pixel> palette = medianCut(std::move(samples));
+			std::copy(palette.begin(), palette.end(), palettes.begin() + size_t(layer) * PALETTE_SIZE);
+
+			// Nearest entry per colour, remembered at 5 bits per channel plus the alpha's top bit
+			std::vector<int16_t> nearest(1 << 16, -1);
+			auto lookup = [&](const olc::Pixel& p) {
+				int key = ((p.r >> 3) << 11) | ((p.g >> 3) << 6) | ((p.b >> 3) << 1) | (p.a >> 7);
+				if (nearest[key] < 0) {
+					int best = 0, bestDistance = INT32_MAX;
+					for (int i = 0; i < PALETTE_SIZE; i++) {
+						int dr = p.r - palette[i].r, dg = p.g - palette[i].g, db = p.b - palette[i].b, da = p.a - palette[i].a;
+						int distance = dr * dr + dg * dg + db * db + da * da;
+						if (distance < bestDistance) {
+							best = i;
+							bestDistance = distance;
+						}
+					}
+					nearest[key] = (int16_t)best;
+				}
+				return (uint8_t)nearest[key];
+			};
+
+			for (int level = 0; level < levels(); level++) {
+				size_t begin = offset(layer, level, 0), count = size_t(levelSizes[level].x) * levelSizes[level].y;
+				for (size_t i = begin; i < begin + count; i++) {
+					indices[i] = lookup(texels[i]);
+				}
+			}
+		}
+		std::vector<olc::Pixel>().swap(texels);
+	}
+
+	// Only before palettize()
+	const olc::Pixel* column(int layer, int level, int x) const { return texels.data() + offset(layer, level, x); }
+	olc::Pixel* column(int layer, int level, int x) { return texels.data() + offset(layer, level, x); }
+
+	// Only after palettize(): a column of palette indices and the layer's palette
+	const uint8_t* indexColumn(int layer, int level, int x) const { return indices.data() + offset(layer, level, x); }
+	const olc::Pixel* palette(int layer) const { return palettes.data() + size_t(layer) * PALETTE_SIZE; }
+
+	// Coarsest level that still has a texel per screen pixel, for texelsPerPixel texels of level 0 per pixel
+	int levelFor(float texelsPerPixel) const {
+		int level = 0;
+		while (texelsPerPixel >= 2.0f && level + 1 < levels()) {
+			texelsPerPixel *= 0.5f;
+			level++;
+		}
+		return level;
+	}
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Next mip level of a column-major texture: a 2x2 box filter, halving each side down to 1
+inline std::vector<olc::Pixel> halveColumns(const olc::Pixel* src, const olc::vi2d& srcSize, olc::vi2d& size) {
+	size = { std::max(1, srcSize.x / 2), std::max(1, srcSize.y / 2) };
+	std::vector<olc::Pixel> dst(size_t(size.x) * size.y);
+	for (int x = 0; x < size.x; x++) {
+		for (int y = 0; y < size.y; y++) {
+			int sum[4] = {};
+			for (int i = 0; i < 4; i++) {
+				int sx = std::min(2 * x + (i & 1), srcSize.x - 1), sy = std::min(2 * y + (i >> 1), srcSize.y - 1);
+				const olc::Pixel& p = src[size_t(sx) * srcSize.y + sy];
+				sum[0] += p.r; sum[1] += p.g; sum[2] += p.b; sum[3] += p.a;
+			}
+			dst[size_t(x) * size.y + y] = olc::Pixel(uint8_t(sum[0] / 4), uint8_t(sum[1] / 4), uint8_t(sum[2] / 4), uint8_t(sum[3] / 4));
+		}
+	}
+	return dst;
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+public:
+	MappedFile(const std::string& path) {
+#if defined(_WIN32)
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER length;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length) || length.QuadPart == 0) return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping) return;
+		data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (data) size = (size_t)length.QuadPart;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED) {
+				data = (const uint8_t*)view;
+				size = (size_t)info.st_size;
+			}
+		}
+		close(fd); // the mapping keeps the file alive
+#endif
+	}
+
+	~MappedFile() {
+#if defined(_WIN32)
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (data) munmap((void*)data, size);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool isOpen() const { return data != nullptr; }
+	const uint8_t* bytes() const { return data; }
+	size_t length() const { return size; }
+};
+
+// Texture cache file layout:
+//   TextureFileHeader: char[4] "RCTX", uint32 version, uint64 hash of the source (path, size, mtime),
+//                      int32 width, int32 height, int32 levels, int32 reserved
+//   TextureFileLevel[levels]: int32 width, int32 height, uint64 offset
+//   then every mip level's texels at its offset (a multiple of PAYLOAD_ALIGNMENT),
+//   column-major since walls are drawn a column at a time: texel (x, y) is at x * height + y.
+struct TextureFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	int32_t width;
+	int32_t height;
+	int32_t levels;
+	int32_t reserved;
+};
+
+struct TextureFileLevel {
+	int32_t width;
+	int32_t height;
+	uint64_t offset;
+};
+
+// A texture cache file used in place: nothing is decoded or copied, texels are
+// read straight from the mapping.
+class MappedTexture {
+	MappedFile file;
+	const TextureFileHeader* header = nullptr;
+	const TextureFileLevel* levelTable = nullptr;
+
+public:
+	static constexpr uint32_t VERSION = 2;
+	static constexpr uint64_t PAYLOAD_ALIGNMENT = 64;
+
+	// Check isValid(): fails for missing, truncated or stale files
+	MappedTexture(const std::string& path, uint64_t sourceHash) : file(path) {
+		if (!file.isOpen() || file.length() < sizeof(TextureFileHeader)) return;
+		const TextureFileHeader* h = (const TextureFileHeader*)file.bytes();
+		if (!std::equal(h->magic, h->magic + 4, "RCTX") || h->version != VERSION || h->sourceHash != sourceHash || h->levels < 1
+			|| file.length() < sizeof(TextureFileHeader) + h->levels * sizeof(TextureFileLevel)) {
+			return;
+		}
+		const TextureFileLevel* table = (const TextureFileLevel*)(file.bytes() + sizeof(TextureFileHeader));
+		for (int i = 0; i < h->levels; i++) {
+			if (table[i].width < 1 || table[i].height < 1 || table[i].offset % PAYLOAD_ALIGNMENT != 0
+				|| table[i].offset + uint64_t(table[i].width) * table[i].height * sizeof(olc::Pixel) > file.length()) {
+				return;
+			}
+		}
+		header = h;
+		levelTable = table;
+	}
+
+	bool isValid() const { return header != nullptr; }
+	int levels() const { return header->levels; }
+	olc::vi2d size(int level = 0) const { return { levelTable[level].width, levelTable[level].height }; }
+
+	const olc::Pixel* column(int level, int x) const {
+		const TextureFileLevel& l = levelTable[level];
+		return (const olc::Pixel*)(file.bytes() + l.offset) + size_t(x) * l.height;
+	}
+
+	// Coarsest level that still has a texel per screen pixel, for texelsPerPixel texels of level 0 per pixel
+	int levelFor(float texelsPerPixel) const {
+		int level = 0;
+		while (texelsPerPixel >= 2.0f && level + 1 < levels()) {
+			texelsPerPixel *= 0.5f;
+			level++;
+		}
+		return level;
+	}
+
+	// Level 0 back in row-major order, for code that needs a Sprite
+	void copyTo(olc::Sprite& sprite) const {
+		olc::vi2d s = size();
+		sprite.width = s.x;
+		sprite.height = s.y;
+		sprite.pColData.resize(size_t(s.x) * s.y);
+		for (int x = 0; x < s.x; x++) {
+			const olc::Pixel* texels = column(0, x);
+			for (int y = 0; y < s.y; y++) {
+				sprite.pColData[size_t(y) * s.x + x] = texels[y];
+			}
+		}
+	}
+};
+
+// Directory of pre-decoded textures, one file per source image named by a
+// hash of the source's path, size and modification time, so edited sources
+// never hit a stale entry and finding an entry never reads the source itself.
+// The first load of an image decodes it and writes its entry, every later one
+// (this run or the next) maps the entry instead.
+class TextureCache {
+	std::string directory;
+
+	static bool hashSource(const std::string& path, uint64_t& hash) {
+#if defined(_WIN32)
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0) return false;
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) return false;
+#endif
+		int64_t stamp[2] = { (int64_t)info.st_size, (int64_t)info.st_mtime };
+		hash = 14695981039346656037ull; // FNV-1a
+		auto add = [&](const void* bytes, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				hash = (hash ^ ((const uint8_t*)bytes)[i]) * 1099511628211ull;
+			}
+		};
+		add(path.data(), path.size());
+		add(stamp, sizeof(stamp));
+		return true;
+	}
+
+	std::string entryPath(uint64_t hash) const {
+		std::ostringstream name;
+		name << directory << '/' << std::hex << std::setw(16) << std::setfill('0') << hash << ".rctx";
+		return name.str();
+	}
+
+	// Box-filtered mip chain down to 1x1, each level column-major
+	static std::vector<std::vector<olc::Pixel>> buildLevels(const olc::Sprite& sprite, std::vector<TextureFileLevel>& table) {
+		std::vector<std::vector<olc::Pixel>> levels;
+		std::vector<olc::Pixel> base(size_t(sprite.width) * sprite.height);
+		for (int x = 0; x < sprite.width; x++) {
+			for (int y = 0; y < sprite.height; y++) {
+				base[size_t(x) * sprite.height + y] = sprite.pColData[size_t(y) * sprite.width + x];
+			}
+		}
+		levels.push_back(std::move(base));
+		table.push_back({ sprite.width, sprite.height, 0 });
+
+		while (table.back().width > 1 || table.back().height > 1) {
+			olc::vi2d size;
+			std::vector<olc::Pixel> next = halveColumns(levels.back().data(), { table.back().width, table.back().height }, size);
+			levels.push_back(std::move(next));
+			table.push_back({ size.x, size.y, 0 });
+		}
+		return levels;
+	}
+
+	bool writeEntry(const std::string& path, const olc::Sprite& sprite, uint64_t hash) const {
+#if defined(_WIN32)
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+		std::vector<TextureFileLevel> table;
+		std::vector<std::vector<olc::Pixel>> levels = buildLevels(sprite, table);
+
+		uint64_t offset = sizeof(TextureFileHeader) + table.size() * sizeof(TextureFileLevel);
+		for (TextureFileLevel& level : table) {
+			offset = (offset + MappedTexture::PAYLOAD_ALIGNMENT - 1) / MappedTexture::PAYLOAD_ALIGNMENT * MappedTexture::PAYLOAD_ALIGNMENT;
+			level.offset = offset;
+			offset += uint64_t(level.width) * level.height * sizeof(olc::Pixel);
+		}
+
+		// Written under a temporary name so a concurrent reader never maps half a
+		// file, unique to this process and thread so concurrent writers don't share it
+#if defined(_WIN32)
+		int process = _getpid();
+#else
+		int process = (int)getpid();
+#endif
+		std::ostringstream temporaryName;
+		temporaryName << path << '.' << process << '.' << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+		std::string temporary = temporaryName.str();
+		{
+			std::ofstream file(temporary, std::ios::binary);
+			TextureFileHeader header = { {'R','C','T','X'}, MappedTexture::VERSION, hash, sprite.width, sprite.height, (int32_t)table.size(), 0 };
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)table.data(), table.size() * sizeof(TextureFileLevel));
+			for (size_t i = 0; i < table.size(); i++) {
+				while ((uint64_t)file.tellp() < table[i].offset) file.put(0);
+				file.write((const char*)levels[i].data(), levels[i].size() * sizeof(olc::Pixel));
+			}
+			if (!file) return false;
+		}
+		std::remove(path.c_str());
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+public:
+	TextureCache(const std::string& directory) : directory(directory) {}
+
+	// Fills sprite with the image at sourcePath, decoding and caching it first if
+	// needed, and sets mapped to its cache entry (null if that couldn't be written).
+	// Without bSprite, an image found in the cache leaves sprite empty: callers
+	// that only read mapped skip copying it out. Returns false if the image can't
+	// be loaded at all.
+	bool load(const std::string& sourcePath, olc::Sprite& sprite, std::shared_ptr<const MappedTexture>& mapped, bool bSprite = true) const {
+		mapped = nullptr;
+		uint64_t hash = 0;
+		if (!hashSource(sourcePath, hash)) return false;
+		std::string path = entryPath(hash);
+
+		auto entry = std::make_shared<const MappedTexture>(path, hash);
+		if (entry->isValid()) {
+			if (bSprite) entry->copyTo(sprite);
+			mapped = entry;
+			return true;
+		}
+
+		if (sprite.LoadFromFile(sourcePath) != olc::rcode::OK) return false;
+		if (writeEntry(path, sprite, hash)) {
+			entry = std::make_shared<const MappedTexture>(path, hash);
+			if (entry->isValid()) mapped = entry;
+		}
+		return true;
+	}
+};
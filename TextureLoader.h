@@ -0,0 +1,109 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "WorkerPool.h"
+#include "TextureCache.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <future>
+#include <unordered_map>
+#include <chrono>
+#include <iostream>
+
+// A texture that is being decoded. sprite is usable right away: it shows a
+// one-pixel placeholder until TextureLoader::poll() swaps the decoded image
+// into it, so pointers to it never change. Textures loaded without a sprite
+// keep the placeholder when they come from the cache, only mapped() has them. decoded becomes ready (true on
+// success) as soon as the decode finishes, before the swap.
+struct TextureHandle {
+	olc::Sprite* sprite;
+	std::shared_future<bool> decoded;
+};
+
+// Decodes images on a WorkerPool, through a TextureCache if it has one. The
+// decoded pixels are only moved into the returned sprites by poll(), which has
+// to be called where nothing reads them (between frames).
+class TextureLoader {
+	struct Decoded {
+		olc::Sprite sprite;
+		std::shared_ptr<const MappedTexture> mapped;
+	};
+
+	struct Pending {
+		olc::Sprite* target;
+		std::string path;
+		std::shared_ptr<Decoded> decoded;
+		std::shared_future<bool> done;
+	};
+
+	WorkerPool& pool;
+	const TextureCache* cache;
+	std::vector<Pending> pending;
+	std::unordered_map<const olc::Sprite*, std::shared_ptr<const MappedTexture>> mappedTextures;
+
+	static void swapIn(olc::Sprite* target, olc::Sprite& decoded) {
+		std::swap(target->width, decoded.width);
+		std::swap(target->height, decoded.height);
+		target->pColData.swap(decoded.pColData);
+	}
+
+public:
+	// cache may be null
+	TextureLoader(WorkerPool& pool, const TextureCache* cache = nullptr) : pool(pool), cache(cache) {}
+
+	~TextureLoader() {
+		for (Pending& load : pending) load.done.wait();
+	}
+
+	// The caller owns the returned sprite. bSprite false is for textures only read
+	// through mapped(), it saves copying cached ones into the sprite.
+	TextureHandle load(const std::string& path, olc::Pixel placeholder = olc::GREY, bool bSprite = true) {
+		olc::Sprite* sprite = new olc::Sprite(1, 1);
+		sprite->SetPixel(0, 0, placeholder);
+
+		std::shared_ptr<Decoded> decoded = std::make_shared<Decoded>();
+		const TextureCache* cache = this->cache;
+		std::shared_future<bool> done = pool.submit([decoded, path, cache, bSprite] {
+			if (cache) return cache->load(path, decoded->sprite, decoded->mapped, bSprite);
+			return decoded->sprite.LoadFromFile(path) == olc::rcode::OK;
+		}).share();
+		pending.push_back({ sprite, path, decoded, done });
+		return { sprite, done };
+	}
+
+	bool isLoading() const { return !pending.empty(); }
+
+	// The cache entry a loaded sprite was filled from (mipmapped, column-major), or null
+	std::shared_ptr<const MappedTexture> mapped(const olc::Sprite* sprite) const {
+		auto it = mappedTextures.find(sprite);
+		return it == mappedTextures.end() ? nullptr : it->second;
+	}
+
+	// Swaps every finished texture into its sprite and returns how many changed.
+	// Failed ones keep their placeholder.
+	int poll() {
+		int swapped = 0;
+		for (size_t i = 0; i < pending.size();) {
+			Pending& load = pending[i];
+			if (load.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				i++;
+				continue;
+			}
+			if (load.done.get()) {
+				if (!load.decoded->sprite.pColData.empty()) swapIn(load.target, load.decoded->sprite);
+				if (load.decoded->mapped) mappedTextures[load.target] = load.decoded->mapped;
+				swapped++;
+			}
+			else {
+				std::cout << "Could not load texture " << load.path << '\n';
+			}
+			pending.erase(pending.begin() + i);
+		}
+		return swapped;
+	}
+
+	int waitAll() {
+		for (Pending& load : pending) load.done.wait();
+		return poll();
+	}
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include "olcPixelGameEngine.h"
+#include "GameMap.h"
+#include "Raycast.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// One run of exposed wall faces along a grid line. face says which side of the
+// solid cells it is on: 0/1 = low/high x, 2/3 = low/high y (the face looks
+// towards -x, +x, -y, +y). plane is the x (faces 0/1) or y (faces 2/3) of the
+// line, the run covers cells [from, to) along it.
+struct WallSegment {
+	int face;
+	int plane;
+	int from;
+	int to;
+	int cellType;
+};
+
+// Columns whose nearest wall is already final, as sorted disjoint [begin, end) runs.
+class SpanBuffer {
+	std::vector<std::pair<int, int>> spans;
+
+public:
+	void clear() { spans.clear(); }
+
+	bool covers(int begin, int end) const {
+		auto it = std::upper_bound(spans.begin(), spans.end(), std::make_pair(begin, INT32_MAX));
+		return it != spans.begin() && (--it)->first <= begin && it->second >= end;
+	}
+
+	void close(int begin, int end) {
+		if (begin >= end) return;
+		auto it = std::lower_bound(spans.begin(), spans.end(), std::make_pair(begin, INT32_MIN));
+		if (it != spans.begin() && std::prev(it)->second >= begin) --it;
+		auto last = it;
+		while (last != spans.end() && last->first <= end) {
+			begin = std::min(begin, last->first);
+			end = std::max(end, last->second);
+			++last;
+		}
+		it = spans.erase(it, last);
+		spans.insert(it, { begin, end });
+	}
+};
+
+// The map's walls as merged axis-aligned segments, bucketed into BUCKET_SIZE
+// squares (segments never cross a bucket) so a view only visits nearby buckets.
+// A face is exposed when its solid cell borders an empty cell inside the map;
+// faces towards the outside can't be seen from inside it.
+class WallSegments {
+	olc::vi2d mapSize;
+	olc::vi2d bucketCount;
+	std::vector<std::vector<WallSegment>> buckets;
+
+	// Scratch for render(), per calling thread
+	struct Scratch {
+		std::vector<float> depth;
+		std::vector<olc::vf2d> dirs;
+		SpanBuffer closed;
+	};
+
+	static bool exposed(const GameMap& map, int x, int y, int face) {
+		static constexpr int dx[4] = { -1, 1, 0, 0 };
+		static constexpr int dy[4] = { 0, 0, -1, 1 };
+		int nx = x + dx[face], ny = y + dy[face];
+		if (nx < 0 || ny < 0 || nx >= map.size().x || ny >= map.size().y) return false;
+		return map.isSolid(x, y) && !map.isSolid(nx, ny);
+	}
+
+	void buildBucket(const GameMap& map, int bx, int by) {
+		std::vector<WallSegment>& segments = buckets[by * bucketCount.x + bx];
+		segments.clear();
+		int x0 = bx * BUCKET_SIZE, y0 = by * BUCKET_SIZE;
+		int x1 = std::min(mapSize.x, x0 + BUCKET_SIZE), y1 = std::min(mapSize.y, y0 + BUCKET_SIZE);
+
+		for (int face = 0; face < 4; face++) {
+			bool bVertical = face < 2; // runs go along y
+			int lines0 = bVertical ? x0 : y0, lines1 = bVertical ? x1 : y1;
+			int along0 = bVertical ? y0 : x0, along1 = bVertical ? y1 : x1;
+			for (int line = lines0; line < lines1; line++) {
+				int runStart = -1, runType = 0;
+				for (int along = along0; along <= along1; along++) {
+					int x = bVertical ? line : along, y = bVertical ? along : line;
+					bool bExposed = along < along1 && exposed(map, x, y, face);
+					int type = bExposed ? map.getCell(x, y) : 0;
+					if (runStart >= 0 && (!bExposed || type != runType)) {
+						segments.push_back({ face, line + face % 2, runStart, along, runType });
+						runStart = -1;
+					}
+					if (bExposed && runStart < 0) {
+						runStart = along;
+						runType = type;
+					}
+				}
+			}
+		}
+	}
+
+public:
+	static constexpr int BUCKET_SIZE = 16;
+
+	void build(const GameMap& map) {
+		mapSize = map.size();
+		bucketCount = { (mapSize.x + BUCKET_SIZE - 1) / BUCKET_SIZE, (mapSize.y + BUCKET_SIZE - 1) / BUCKET_SIZE };
+		buckets.assign(size_t(bucketCount.x) * bucketCount.y, {});
+		for (int by = 0; by < bucketCount.y; by++) {
+			for (int bx = 0; bx < bucketCount.x; bx++) {
+				buildBucket(map, bx, by);
+			}
+		}
+	}
+
+	// Cells in rect changed; their neighbours' faces may have too
+	void update(const GameMap& map, const MapRect& rect) {
+		int bx0 = std::max(0, (rect.min.x - 1) / BUCKET_SIZE), by0 = std::max(0, (rect.min.y - 1) / BUCKET_SIZE);
+		int bx1 = std::min(bucketCount.x - 1, rect.max.x / BUCKET_SIZE), by1 = std::min(bucketCount.y - 1, rect.max.y / BUCKET_SIZE);
+		for (int by = by0; by <= by1; by++) {
+			for (int bx = bx0; bx <= bx1; bx++) {
+				buildBucket(map, bx, by);
+			}
+		}
+	}
+
+	size_t segmentCount() const {
+		size_t count = 0;
+		for (const auto& bucket : buckets) count += bucket.size();
+		return count;
+	}
+
+	// Fills hits[x0, x1) for a view of `columns` columns spread over fov around
+	// angle, like cast_ray would for each column. Buckets are visited in rings
+	// around the viewer; after each ring, columns whose wall is nearer than
+	// anything in the remaining rings are closed, segments that only cover
+	// closed columns are skipped, and it stops once every column is closed.
+	void render(const olc::vf2d& pos, float angle, float fov, int columns, int x0, int x1, float maxDistance, std::vector<RaycastResult>& hits) const {
+		thread_local Scratch scratch;
+		std::vector<float>& depth = scratch.depth;
+		std::vector<olc::vf2d>& dirs = scratch.dirs;
+		SpanBuffer& closed = scratch.closed;
+		depth.assign(x1 - x0, maxDistance);
+		dirs.resize(x1 - x0);
+		closed.clear();
+		for (int x = x0; x < x1; x++) {
+			float columnAngle = x / (float)columns * fov - fov / 2 + angle;
+			dirs[x - x0] = { cosf(columnAngle), sinf(columnAngle) };
+			hits[x] = { false, maxDistance, olc::vi2d(pos) };
+		}
+
+		// Only what lies in the wedge between the first and the last column's ray can be hit
+		olc::vf2d left = dirs.front(), right = dirs.back();
+		auto outside = [&](std::initializer_list<olc::vf2d> points) {
+			bool bLeft = true, bRight = true;
+			for (const olc::vf2d& p : points) {
+				olc::vf2d r = p - pos;
+				bLeft &= left.cross(r) < 0;
+				bRight &= r.cross(right) < 0;
+			}
+			return bLeft || bRight;
+		};
+
+		auto columnOf = [&](const olc::vf2d& p, bool& bBehind) {
+			float rel = std::atan2(p.y - pos.y, p.x - pos.x) - angle;
+			rel = std::remainder(rel, 2.0f * 3.14159265f);
+			bBehind |= std::abs(rel) > 3.14159265f / 2;
+			return (rel + fov / 2) / fov * columns;
+		};
+
+		auto rasterize = [&](const WallSegment& segment) {
+			int axis = segment.face / 2;
+			float o = axis ? pos.y : pos.x;
+			if (segment.face % 2 == 0 ? o >= segment.plane : o <= segment.plane) return; // back face
+
+			olc::vf2d from = axis ? olc::vf2d(float(segment.from), float(segment.plane)) : olc::vf2d(float(segment.plane), float(segment.from));
+			olc::vf2d to = axis ? olc::vf2d(float(segment.to), float(segment.plane)) : olc::vf2d(float(segment.plane), float(segment.to));
+			if (outside({ from, to })) return;
+
+			bool bBehind = false;
+			float a = columnOf(from, bBehind), b = columnOf(to, bBehind);
+			int begin = x0, end = x1;
+			if (!bBehind) {
+				begin = std::max(x0, (int)std::floor(std::min(a, b)));
+				end = std::min(x1, (int)std::ceil(std::max(a, b)) + 1);
+			}
+			if (begin >= end || closed.covers(begin, end)) return;
+
+			for (int x = begin; x < end; x++) {
+				const olc::vf2d& dir = dirs[x - x0];
+				float d = axis ? dir.y : dir.x;
+				if (d == 0) continue;
+				float t = (segment.plane - o) / d;
+				if (t <= 0 || t >= depth[x - x0]) continue;
+				float along = axis ? pos.x + dir.x * t : pos.y + dir.y * t;
+				if (along < segment.from || along > segment.to) continue;
+
+				int cellAlong = std::min(segment.to - 1, std::max(segment.from, (int)std::floor(along)));
+				int cellAcross = segment.plane - segment.face % 2;
+				depth[x - x0] = t;
+				hits[x] = { true, t, axis ? olc::vi2d(cellAlong, cellAcross) : olc::vi2d(cellAcross, cellAlong), segment.cellType };
+			}
+		};
+
+		olc::vi2d home(int(std::floor(pos.x / BUCKET_SIZE)), int(std::floor(pos.y / BUCKET_SIZE)));
+		int maxRing = int(maxDistance / BUCKET_SIZE) + 1;
+		for (int ring = 0; ring <= maxRing; ring++) {
+			for (int by = home.y - ring; by <= home.y + ring; by++) {
+				if (by < 0 || by >= bucketCount.y) continue;
+				bool bEdgeRow = by == home.y - ring || by == home.y + ring;
+				for (int bx = home.x - ring; bx <= home.x + ring; bx += bEdgeRow || ring == 0 ? 1 : 2 * ring) {
+					if (bx < 0 || bx >= bucketCount.x) continue;
+					olc::vf2d min(float(bx * BUCKET_SIZE), float(by * BUCKET_SIZE)), max = min + olc::vf2d(float(BUCKET_SIZE), float(BUCKET_SIZE));
+					if (outside({ min, max, { min.x, max.y }, { max.x, min.y } })) continue;
+					for (const WallSegment& segment : buckets[by * bucketCount.x + bx]) {
+						rasterize(segment);
+					}
+				}
+			}
+
+			// Later rings are at least ring * BUCKET_SIZE away
+			float final = float(ring * BUCKET_SIZE);
+			for (int x = x0; x < x1;) {
+				if (depth[x - x0] >= final) { x++; continue; }
+				int run = x;
+				while (x < x1 && depth[x - x0] < final) x++;
+				closed.close(run, x);
+			}
+			if (closed.covers(x0, x1)) break;
+		}
+	}
+};
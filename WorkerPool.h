@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+
+// Fixed set of threads running submitted tasks in FIFO order.
+class WorkerPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable signal;
+	std::deque<std::function<void()>> tasks;
+	bool bStop = false;
+
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			signal.wait(lock, [&] { return bStop || !tasks.empty(); });
+			if (tasks.empty()) return; // only when stopping
+
+			std::function<void()> task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	}
+
+public:
+	// threadCount 0 = one per hardware thread
+	WorkerPool(int threadCount = 0) {
+		if (threadCount <= 0) threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 0; i < threadCount; i++) {
+			threads.emplace_back(&WorkerPool::workerLoop, this);
+		}
+	}
+
+	// Finishes whatever is queued, then joins
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			bStop = true;
+		}
+		signal.notify_all();
+		for (std::thread& thread : threads) thread.join();
+	}
+
+	int size() const { return (int)threads.size(); }
+
+	template <typename Task>
+	auto submit(Task task) -> std::future<decltype(task())> {
+		auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+		std::future<decltype(task())> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace_back([packaged] { (*packaged)(); });
+		}
+		signal.notify_one();
+		return result;
+	}
+
+	// Queues body(begin, end) over [0, count) in pieces of at most `grain` and returns
+	// without waiting. body is kept alive until the last piece has run.
+	template <typename Body>
+	std::vector<std::future<void>> parallelForAsync(int count, int grain, Body body) {
+		auto shared = std::make_shared<Body>(std::move(body));
+		std::vector<std::future<void>> pieces;
+		for (int begin = 0; begin < count; begin += grain) {
+			int end = std::min(count, begin + grain);
+			pieces.push_back(submit([shared, begin, end] { (*shared)(begin, end); }));
+		}
+		return pieces;
+	}
+
+	// Waits for every piece, then rethrows the first exception if there was one
+	static void wait(std::vector<std::future<void>>& pieces) {
+		for (std::future<void>& piece : pieces) piece.wait();
+		for (std::future<void>& piece : pieces) piece.get();
+		pieces.clear();
+	}
+
+	template <typename Body>
+	void parallelFor(int count, int grain, Body body) {
+		std::vector<std::future<void>> pieces = parallelForAsync(count, grain, body);
+		wait(pieces);
+	}
+};